@@ -4,150 +4,294 @@
 #include <string.h>
 #include <stdio.h>
 
+#define CACHE_INITIAL_BUCKETS 64
+
+// Hash FNV-1a do path
+static size_t hash_key(const char* key) {
+    size_t h = 14695981039346656037ULL;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Os bits altos escolhem o shard, os baixos o bucket dentro do shard
+static cache_shard_t* shard_for(cache_t* cache, size_t hash) {
+    return &cache->shards[(hash >> 56) % CACHE_SHARDS];
+}
+
+// Procura no índice do shard
+static cache_entry_t* hash_find(cache_shard_t* shard, const char* key, size_t hash) {
+    cache_entry_t* e = shard->buckets[hash & (shard->num_buckets - 1)];
+    while (e) {
+        if (e->hash == hash && strcmp(e->key, key) == 0) return e;
+        e = e->hnext;
+    }
+    return NULL;
+}
+
+// Duplica o número de buckets quando a ocupação passa de 75%
+static void hash_grow(cache_shard_t* shard) {
+    size_t new_count = shard->num_buckets * 2;
+    cache_entry_t** new_buckets = calloc(new_count, sizeof(cache_entry_t*));
+    if (!new_buckets) return; // Continua a funcionar, só com cadeias mais longas
+
+    for (size_t i = 0; i < shard->num_buckets; i++) {
+        cache_entry_t* e = shard->buckets[i];
+        while (e) {
+            cache_entry_t* next = e->hnext;
+            size_t idx = e->hash & (new_count - 1);
+            e->hnext = new_buckets[idx];
+            new_buckets[idx] = e;
+            e = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = new_buckets;
+    shard->num_buckets = new_count;
+}
+
+static void hash_insert(cache_shard_t* shard, cache_entry_t* entry) {
+    if ((shard->count + 1) * 4 > shard->num_buckets * 3) hash_grow(shard);
+
+    size_t idx = entry->hash & (shard->num_buckets - 1);
+    entry->hnext = shard->buckets[idx];
+    shard->buckets[idx] = entry;
+    shard->count++;
+}
+
+static void hash_remove(cache_shard_t* shard, cache_entry_t* entry) {
+    cache_entry_t** link = &shard->buckets[entry->hash & (shard->num_buckets - 1)];
+    while (*link) {
+        if (*link == entry) {
+            *link = entry->hnext;
+            shard->count--;
+            return;
+        }
+        link = &(*link)->hnext;
+    }
+}
+
 // Função auxiliar para libertar uma entrada
 void free_entry(cache_entry_t* entry) {
     if (entry) {
         if (entry->key) free(entry->key);
-        if (entry->data) free(entry->data);
         free(entry);
     }
 }
 
+// Larga uma referência; a última liberta a memória
+static void entry_unref(cache_entry_t* entry) {
+    if (atomic_fetch_sub(&entry->refs, 1) == 1) free_entry(entry);
+}
+
 cache_t* cache_init(size_t max_size_mb) {
     cache_t* cache = malloc(sizeof(cache_t));
     if (!cache) return NULL;
 
-    cache->head = NULL;
-    cache->tail = NULL;
     cache->max_size = max_size_mb * 1024 * 1024; // Converter MB para Bytes
-    cache->current_size = 0;
+    atomic_init(&cache->current_size, 0);
+    cache->shared = NULL;
 
-    if (pthread_rwlock_init(&cache->lock, NULL) != 0) {
-        free(cache);
-        return NULL;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard_t* shard = &cache->shards[i];
+        shard->hand = NULL;
+        shard->current_size = 0;
+        shard->count = 0;
+        shard->num_buckets = CACHE_INITIAL_BUCKETS;
+        shard->buckets = calloc(shard->num_buckets, sizeof(cache_entry_t*));
+
+        if (!shard->buckets || pthread_rwlock_init(&shard->lock, NULL) != 0) {
+            free(shard->buckets);
+            for (int j = 0; j < i; j++) {
+                pthread_rwlock_destroy(&cache->shards[j].lock);
+                free(cache->shards[j].buckets);
+            }
+            free(cache);
+            return NULL;
+        }
     }
 
     return cache;
 }
 
+cache_t* cache_init_shared(int worker_id) {
+    shm_cache_t* shared = shm_cache_attach(worker_id);
+    if (!shared) return NULL;
+
+    cache_t* cache = cache_init(0);
+    if (!cache) {
+        shm_cache_detach(shared);
+        return NULL;
+    }
+    cache->shared = shared;
+    return cache;
+}
+
 void cache_destroy(cache_t* cache) {
     if (!cache) return;
+    if (cache->shared) shm_cache_detach(cache->shared);
 
-    pthread_rwlock_wrlock(&cache->lock);
-    
-    cache_entry_t* current = cache->head;
-    while (current) {
-        cache_entry_t* next = current->next;
-        free_entry(current);
-        current = next;
-    }
+    // Nota: todas as referências dos callers já devem ter sido libertadas
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard_t* shard = &cache->shards[i];
+        pthread_rwlock_wrlock(&shard->lock);
+
+        if (shard->hand) {
+            cache_entry_t* current = shard->hand;
+            do {
+                cache_entry_t* next = current->next;
+                entry_unref(current);
+                current = next;
+            } while (current != shard->hand);
+        }
 
-    pthread_rwlock_unlock(&cache->lock);
-    pthread_rwlock_destroy(&cache->lock);
+        pthread_rwlock_unlock(&shard->lock);
+        pthread_rwlock_destroy(&shard->lock);
+        free(shard->buckets);
+    }
     free(cache);
 }
 
-// Move uma entrada para o início da lista (LRU: Most Recently Used)
-// Nota: Assume que o lock de escrita já está adquirido!
-void move_to_head(cache_t* cache, cache_entry_t* entry) {
-    if (entry == cache->head) return; // Já é o primeiro
-
-    // Remover da posição atual
-    if (entry->prev) entry->prev->next = entry->next;
-    if (entry->next) entry->next->prev = entry->prev;
-    if (entry == cache->tail) cache->tail = entry->prev;
-
-    // Inserir no início
-    entry->next = cache->head;
-    entry->prev = NULL;
-    if (cache->head) cache->head->prev = entry;
-    cache->head = entry;
-    
-    if (!cache->tail) cache->tail = entry;
-}
-
-void* cache_get(cache_t* cache, const char* key, size_t* out_size) {
-    void* data_copy = NULL;
-    
-    // Usamos Write Lock para poder atualizar o LRU (move_to_head)
-    pthread_rwlock_wrlock(&cache->lock);
-
-    cache_entry_t* current = cache->head;
-    while (current) {
-        if (strcmp(current->key, key) == 0) {
-            // Encontrado! Mover para o início (LRU)
-            move_to_head(cache, current);
-            
-            // --- CÓPIA SEGURA ---
-            data_copy = malloc(current->size);
-            if (data_copy) {
-                memcpy(data_copy, current->data, current->size);
-                if (out_size) *out_size = current->size;
-            }
-            // --------------------
-            
-            pthread_rwlock_unlock(&cache->lock);
-            return data_copy;
-        }
-        current = current->next;
+// Retira a entrada do anel e do índice, e larga a referência da cache.
+// Quem ainda a estiver a enviar mantém os dados válidos até ao cache_release().
+// Nota: Assume que o lock de escrita do shard já está adquirido!
+static void remove_entry(cache_t* cache, cache_shard_t* shard, cache_entry_t* entry) {
+    if (entry->next == entry) {
+        shard->hand = NULL; // Era a única
+    } else {
+        entry->prev->next = entry->next;
+        entry->next->prev = entry->prev;
+        if (shard->hand == entry) shard->hand = entry->next;
     }
 
-    pthread_rwlock_unlock(&cache->lock);
-    return NULL;
+    hash_remove(shard, entry);
+    shard->current_size -= entry->size;
+    atomic_fetch_sub(&cache->current_size, entry->size);
+    entry_unref(entry);
 }
 
-void cache_put(cache_t* cache, const char* key, void* data, size_t size) {
-    pthread_rwlock_wrlock(&cache->lock);
-
-    // 1. Verificar se já existe (atualizar)
-    cache_entry_t* current = cache->head;
-    while (current) {
-        if (strcmp(current->key, key) == 0) {
-            // Atualizar dados
-            cache->current_size -= current->size;
-            free(current->data);
-            
-            current->data = malloc(size);
-            memcpy(current->data, data, size);
-            current->size = size;
-            cache->current_size += size;
-            
-            move_to_head(cache, current);
-            pthread_rwlock_unlock(&cache->lock);
-            return;
+// CLOCK (second chance): avança o ponteiro limpando os bits de referência
+// e remove a primeira entrada que não foi usada desde a última volta.
+// Nota: Assume que o lock de escrita do shard já está adquirido!
+static void evict_one(cache_t* cache, cache_shard_t* shard) {
+    while (atomic_exchange_explicit(&shard->hand->referenced, 0, memory_order_relaxed)) {
+        shard->hand = shard->hand->next;
+    }
+    remove_entry(cache, shard, shard->hand);
+}
+
+// Liberta espaço até 'size' caber no orçamento global, começando pelo shard
+// onde se vai inserir (já bloqueado) e passando aos outros se for preciso.
+static void make_room(cache_t* cache, cache_shard_t* home, size_t size) {
+    while (atomic_load(&cache->current_size) + size > cache->max_size && home->hand) {
+        evict_one(cache, home);
+    }
+
+    for (int i = 0; i < CACHE_SHARDS && atomic_load(&cache->current_size) + size > cache->max_size; i++) {
+        cache_shard_t* shard = &cache->shards[i];
+        if (shard == home) continue;
+
+        // Nunca se bloqueiam dois shards à espera: evita deadlocks entre puts
+        if (pthread_rwlock_trywrlock(&shard->lock) != 0) continue;
+        while (atomic_load(&cache->current_size) + size > cache->max_size && shard->hand) {
+            evict_one(cache, shard);
         }
-        current = current->next;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+}
+
+const void* cache_get(cache_t* cache, const char* key, size_t* out_size) {
+    if (cache->shared) return shm_cache_get(cache->shared, key, out_size);
+
+    const void* data = NULL;
+    size_t hash = hash_key(key);
+    cache_shard_t* shard = shard_for(cache, hash);
+
+    // Read Lock: vários hits em paralelo, mesmo no mesmo shard
+    pthread_rwlock_rdlock(&shard->lock);
+
+    cache_entry_t* current = hash_find(shard, key, hash);
+    if (current) {
+        // Marcar como usada (só escreve se ainda não estiver marcada)
+        if (!atomic_load_explicit(&current->referenced, memory_order_relaxed))
+            atomic_store_explicit(&current->referenced, 1, memory_order_relaxed);
+
+        // Zero-copy: o caller fica com uma referência à entrada
+        atomic_fetch_add(&current->refs, 1);
+        data = current->data;
+        if (out_size) *out_size = current->size;
     }
 
-    // 2. Verificar espaço (Eviction)
-    while (cache->current_size + size > cache->max_size && cache->tail) {
-        // Remover o último (LRU)
-        cache_entry_t* old_tail = cache->tail;
-        
-        cache->current_size -= old_tail->size;
-        
-        if (old_tail->prev) old_tail->prev->next = NULL;
-        cache->tail = old_tail->prev;
-        if (cache->head == old_tail) cache->head = NULL;
+    pthread_rwlock_unlock(&shard->lock);
+    return data;
+}
 
-        free_entry(old_tail);
+void cache_release(cache_t* cache, const void* data) {
+    if (cache->shared) {
+        shm_cache_release(cache->shared, data);
+        return;
     }
+    if (!data) return;
+    cache_entry_t* entry = (cache_entry_t*)((unsigned char*)data - offsetof(cache_entry_t, data));
+    entry_unref(entry);
+}
+
+const cache_meta_t* cache_get_meta(cache_t* cache, const void* data) {
+    if (cache->shared) return shm_cache_meta(data);
+    const cache_entry_t* entry = (const cache_entry_t*)((const unsigned char*)data - offsetof(cache_entry_t, data));
+    return &entry->meta;
+}
 
-    // 3. Inserir novo no início
-    cache_entry_t* new_entry = malloc(sizeof(cache_entry_t));
+void cache_put(cache_t* cache, const char* key, void* data, size_t size, const cache_meta_t* meta) {
+    if (cache->shared) {
+        shm_cache_put(cache->shared, key, data, size, meta);
+        return;
+    }
+
+    // Preparar a nova entrada fora do lock (cópia única dos dados)
+    cache_entry_t* new_entry = malloc(sizeof(cache_entry_t) + size);
+    if (!new_entry) return;
     new_entry->key = strdup(key);
-    new_entry->data = malloc(size);
-    memcpy(new_entry->data, data, size);
+    if (!new_entry->key) {
+        free(new_entry);
+        return;
+    }
+    new_entry->hash = hash_key(key);
     new_entry->size = size;
+    atomic_init(&new_entry->refs, 1); // Referência da própria cache
+    atomic_init(&new_entry->referenced, 0);
+    if (meta) new_entry->meta = *meta;
+    else memset(&new_entry->meta, 0, sizeof(new_entry->meta));
+    memcpy(new_entry->data, data, size);
 
-    new_entry->next = cache->head;
-    new_entry->prev = NULL;
+    cache_shard_t* shard = shard_for(cache, new_entry->hash);
+    pthread_rwlock_wrlock(&shard->lock);
 
-    if (cache->head) cache->head->prev = new_entry;
-    cache->head = new_entry;
-    if (!cache->tail) cache->tail = new_entry;
+    // 1. Verificar se já existe: as entradas são imutáveis, por isso
+    // a antiga é substituída (quem a estiver a usar não é afetado)
+    cache_entry_t* current = hash_find(shard, key, new_entry->hash);
+    if (current) remove_entry(cache, shard, current);
 
-    cache->current_size += size;
+    // 2. Verificar espaço (Eviction CLOCK)
+    make_room(cache, shard, size);
 
-    pthread_rwlock_unlock(&cache->lock);
-}
\ No newline at end of file
+    // 3. Inserir imediatamente atrás do ponteiro (a última a ser visitada)
+    if (shard->hand) {
+        new_entry->next = shard->hand;
+        new_entry->prev = shard->hand->prev;
+        shard->hand->prev->next = new_entry;
+        shard->hand->prev = new_entry;
+    } else {
+        new_entry->next = new_entry;
+        new_entry->prev = new_entry;
+        shard->hand = new_entry;
+    }
+
+    hash_insert(shard, new_entry);
+    shard->current_size += size;
+    atomic_fetch_add(&cache->current_size, size);
+
+    pthread_rwlock_unlock(&shard->lock);
+}
@@ -4,30 +4,66 @@
 
 #include <pthread.h>
 #include <stddef.h> // Adicionado para size_t
+#include <stdatomic.h>
+#include "shm_cache.h"
 
+#define CACHE_SHARDS 16
+
+// Entradas imutáveis com contagem de referências: a cache tem uma
+// referência enquanto a entrada está no shard, e cada cache_get() outra.
+// A memória só é libertada quando a última referência sai.
 typedef struct cache_entry {
     char* key;
-    void* data;
+    size_t hash;
     size_t size;
-    struct cache_entry* next;
+    atomic_int refs;
+    atomic_int referenced;     // Bit de referência do CLOCK (marcado nos hits)
+    struct cache_entry* next;  // Anel do CLOCK
     struct cache_entry* prev;
+    struct cache_entry* hnext; // Cadeia do bucket na tabela de hash
+    cache_meta_t meta;         // Validadores (ETag/Last-Modified) e MIME
+    unsigned char data[];      // Corpo do ficheiro (alocado com a entrada)
 } cache_entry_t;
 
+// Cada shard tem o seu lock, índice e anel CLOCK. Os hits só precisam
+// do read lock: a recência é um bit atómico, não uma mudança na lista.
 typedef struct {
-    cache_entry_t* head;
-    cache_entry_t* tail;
     pthread_rwlock_t lock;
-    size_t max_size;
+
+    // Índice por path: lookup O(1)
+    cache_entry_t** buckets;
+    size_t num_buckets;
+    size_t count;
+
+    cache_entry_t* hand;       // Ponteiro do CLOCK (NULL se o shard está vazio)
     size_t current_size;
+} cache_shard_t;
+
+typedef struct {
+    cache_shard_t shards[CACHE_SHARDS];
+    size_t max_size;
+    atomic_size_t current_size; // Soma de todos os shards
+
+    // Se não for NULL, todas as operações usam a cache partilhada (SHARED_CACHE=1)
+    shm_cache_t* shared;
 } cache_t;
 
 cache_t* cache_init(size_t max_size_mb);
 
-// --- ALTERADO ---
-// Devolve uma CÓPIA dos dados (que deve ser libertada com free pelo caller)
-void* cache_get(cache_t* cache, const char* key, size_t* out_size);
+// Cache ligada ao segmento partilhado criado pelo Master (referências contadas
+// em nome de worker_id, para o Master as poder largar se o worker morrer)
+cache_t* cache_init_shared(int worker_id);
+
+// Devolve os dados da entrada SEM cópia, com uma referência adquirida.
+// O caller não pode alterar os dados e tem de chamar cache_release() no fim.
+const void* cache_get(cache_t* cache, const char* key, size_t* out_size);
+void cache_release(cache_t* cache, const void* data);
+
+// Metadados da entrada devolvida por cache_get() (válidos até ao cache_release)
+const cache_meta_t* cache_get_meta(cache_t* cache, const void* data);
 
-void cache_put(cache_t* cache, const char* key, void* data, size_t size);
+// 'meta' pode ser NULL (metadados a zeros)
+void cache_put(cache_t* cache, const char* key, void* data, size_t size, const cache_meta_t* meta);
 void cache_destroy(cache_t* cache);
 
 #endif
\ No newline at end of file
@@ -1,79 +1,594 @@
 // src/cgi.c
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // pipe2
 #include "cgi.h"
 #include "http.h" // Para send_http_response
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <stddef.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <pthread.h>
 
-int handle_cgi_request(int client_fd, const char* script_path) {
+extern char** environ;
+
+#define CGI_HEADER_MAX 8192    // Headers emitidos pelo script têm de caber aqui
+#define CGI_RELAY_BUFFER 16384 // Output reencaminhado para o cliente em blocos deste tamanho
+#define CGI_ENV_MAX 8
+#define CGI_CAPTURE_MAX (1024 * 1024) // Respostas maiores não entram na micro-cache
+
+// Estado do pool: preenchido pelo Master antes do fork dos workers, que
+// herdam o endereço (o socket de escuta só interessa aos interpretadores)
+static int pool_listen_fd = -1;
+static struct sockaddr_un pool_addr;
+static socklen_t pool_addr_len = 0;
+static char pool_dir[64]; // Diretório 0700 do socket (só o uid do servidor lá entra)
+static int pool_size = 0;
+static int pool_timeout = 30;
+static pid_t pool_pids[CGI_POOL_MAX];
+
+// Argumentos do runner: fd, timeout e as raízes de onde pode correr scripts
+static char runner_fd_arg[16], runner_timeout_arg[16];
+static char* runner_argv[5 + 10 + 1];
+
+// --- Master ---
+
+static pid_t spawn_interpreter(void) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    // Filho: só fica com stdin/stdout/stderr e o socket de escuta
+    for (int fd = 3; fd < 1024; fd++) {
+        if (fd != pool_listen_fd) close(fd);
+    }
+    execvp("python3", runner_argv);
+    perror("CGI pool exec error");
+    _exit(1);
+}
+
+// Remove o socket e o diretório privado
+static void remove_socket_dir(void) {
+    if (pool_dir[0] == '\0') return;
+    unlink(pool_addr.sun_path);
+    rmdir(pool_dir);
+    pool_dir[0] = '\0';
+}
+
+int cgi_pool_start(const server_config_t* config) {
+    int size = config->cgi_pool_size;
+    if (size <= 0) return -1;
+    if (size > CGI_POOL_MAX) size = CGI_POOL_MAX;
+    pool_timeout = (config->cgi_timeout > 0) ? config->cgi_timeout : 30;
+
+    // 1. Socket Unix com caminho num diretório 0700 criado pelo mkdtemp:
+    // outros utilizadores locais não conseguem ligar-se ao pool (um socket
+    // abstrato não tem permissões). O runner confirma ainda o uid (SO_PEERCRED).
+    snprintf(pool_dir, sizeof(pool_dir), "/tmp/webserver_cgi.XXXXXX");
+    if (!mkdtemp(pool_dir)) {
+        pool_dir[0] = '\0';
+        return -1;
+    }
+    memset(&pool_addr, 0, sizeof(pool_addr));
+    pool_addr.sun_family = AF_UNIX;
+    snprintf(pool_addr.sun_path, sizeof(pool_addr.sun_path), "%s/pool.sock", pool_dir);
+    pool_addr_len = sizeof(pool_addr);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*)&pool_addr, pool_addr_len) < 0 ||
+        chmod(pool_addr.sun_path, 0600) < 0 || listen(fd, 128) < 0) {
+        if (fd >= 0) close(fd);
+        remove_socket_dir();
+        pool_addr_len = 0;
+        return -1;
+    }
+    pool_listen_fd = fd;
+
+    // 2. Argumentos do runner, prontos antes de qualquer fork
+    int argc = 0;
+    snprintf(runner_fd_arg, sizeof(runner_fd_arg), "%d", pool_listen_fd);
+    snprintf(runner_timeout_arg, sizeof(runner_timeout_arg), "%d", pool_timeout);
+    runner_argv[argc++] = "python3";
+    runner_argv[argc++] = CGI_RUNNER_PATH;
+    runner_argv[argc++] = runner_fd_arg;
+    runner_argv[argc++] = runner_timeout_arg;
+    runner_argv[argc++] = (char*)config->document_root;
+    for (int i = 0; i < config->vhost_count && i < 10; i++) runner_argv[argc++] = (char*)config->vhosts[i].root;
+    runner_argv[argc] = NULL;
+
+    // 3. Lançar os interpretadores (todos fazem accept() no mesmo socket)
+    pool_size = size;
+    for (int i = 0; i < size; i++) pool_pids[i] = spawn_interpreter();
+    return 0;
+}
+
+void cgi_pool_reap(void) {
+    for (int i = 0; i < pool_size; i++) {
+        if (pool_pids[i] > 0 && waitpid(pool_pids[i], NULL, WNOHANG) == 0) continue;
+        // Morreu (ou o fork falhou): os pedidos em fila esperam pelo substituto
+        pool_pids[i] = spawn_interpreter();
+        if (pool_pids[i] > 0) printf("Master: interpretador CGI %d relançado (PID %d)\n", i, pool_pids[i]);
+    }
+}
+
+void cgi_pool_stop(void) {
+    for (int i = 0; i < pool_size; i++) {
+        if (pool_pids[i] > 0) kill(pool_pids[i], SIGTERM);
+    }
+    for (int i = 0; i < pool_size; i++) {
+        if (pool_pids[i] > 0) waitpid(pool_pids[i], NULL, 0);
+    }
+    pool_size = 0;
+    if (pool_listen_fd >= 0) close(pool_listen_fd);
+    pool_listen_fd = -1;
+    remove_socket_dir();
+}
+
+void cgi_pool_worker_init(void) {
+    if (pool_listen_fd >= 0) close(pool_listen_fd);
+    pool_listen_fd = -1;
+    pool_size = 0;       // Os PIDs são do Master
+    pool_dir[0] = '\0'; // E o diretório do socket também
+}
+
+// --- Execução ---
+
+// Output de um script em curso: socket do pool (em frames) ou pipe do fork
+typedef struct {
+    int fd;
+    pid_t pid;           // Fork: processo do script (0 no pool)
+    int framed;          // Pool: frames 'D' (dados) e 'E' (fim + status)
+    uint32_t frame_left; // Bytes por ler no frame 'D' atual
+    int done;
+    int status;          // Com done: 0 = o script terminou bem
+} cgi_stream_t;
+
+static int read_exact(int fd, void* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, (char*)buf + got, len - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        got += n;
+    }
+    return 0;
+}
+
+// Próximo bloco de output. Devolve 0 no fim (st->status diz se o script
+// terminou bem; um interpretador que morre ou excede o tempo conta como falha).
+static ssize_t cgi_read(cgi_stream_t* st, char* buf, size_t cap) {
+    while (!st->done) {
+        if (!st->framed) {
+            ssize_t n = read(st->fd, buf, cap);
+            if (n < 0 && errno == EINTR) continue;
+            if (n > 0) return n;
+            int wstatus;
+            if (n < 0) kill(st->pid, SIGKILL);
+            waitpid(st->pid, &wstatus, 0);
+            st->pid = 0;
+            st->done = 1;
+            st->status = (n == 0 && WIFEXITED(wstatus)) ? WEXITSTATUS(wstatus) : 1;
+            break;
+        }
+
+        if (st->frame_left == 0) {
+            unsigned char h[5];
+            if (read_exact(st->fd, h, sizeof(h)) < 0) {
+                st->done = 1;
+                st->status = 1;
+                break;
+            }
+            uint32_t len = (uint32_t)h[1] << 24 | (uint32_t)h[2] << 16 | (uint32_t)h[3] << 8 | h[4];
+            if (h[0] == 'E') {
+                st->done = 1;
+                st->status = len;
+                break;
+            }
+            st->frame_left = len;
+            continue;
+        }
+
+        ssize_t n = read(st->fd, buf, cap < st->frame_left ? cap : st->frame_left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            st->done = 1;
+            st->status = 1;
+            break;
+        }
+        st->frame_left -= n;
+        return n;
+    }
+    return 0;
+}
+
+static void cgi_close(cgi_stream_t* st) {
+    close(st->fd);
+    if (st->pid > 0) { // Cliente desistiu a meio: o script já não tem para onde escrever
+        kill(st->pid, SIGKILL);
+        waitpid(st->pid, NULL, 0);
+    }
+}
+
+// Pedido a um interpretador do pool. Devolve -1 se o pool não está
+// disponível (tentar com fork).
+static int open_pooled(cgi_stream_t* st, char* const env[]) {
+    if (pool_addr_len == 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&pool_addr, pool_addr_len) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // O runner corta o script ao fim de CGI_TIMEOUT; isto só protege o
+    // worker de um interpretador que deixou de responder
+    struct timeval tv = {pool_timeout + 5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // Ambiente: "NOME=valor\n" por linha, terminado por uma linha vazia
+    char request[2048];
+    int req_len = 0;
+    for (int i = 0; env[i] && req_len < (int)sizeof(request); i++) {
+        req_len += snprintf(request + req_len, sizeof(request) - req_len, "%s\n", env[i]);
+    }
+    if (req_len < (int)sizeof(request)) req_len += snprintf(request + req_len, sizeof(request) - req_len, "\n");
+    struct iovec iov = {request, req_len < (int)sizeof(request) ? req_len : (int)sizeof(request) - 1};
+
+    memset(st, 0, sizeof(*st));
+    st->fd = fd;
+    st->framed = 1;
+    if (http_send_iov(fd, &iov, 1, 0) < 0) { // Interpretador morreu: o fim vem como falha
+        st->done = 1;
+        st->status = 1;
+    }
+    return 0;
+}
+
+// Caminho do python3 no PATH, resolvido uma vez (o filho só pode fazer execve)
+static char python_path[512] = "/usr/bin/python3";
+static pthread_once_t python_once = PTHREAD_ONCE_INIT;
+
+static void resolve_python(void) {
+    const char* path = getenv("PATH");
+    while (path && *path) {
+        const char* sep = strchr(path, ':');
+        int len = sep ? (int)(sep - path) : (int)strlen(path);
+        char candidate[sizeof(python_path)];
+        snprintf(candidate, sizeof(candidate), "%.*s/python3", len, path);
+        if (len > 0 && access(candidate, X_OK) == 0) {
+            memcpy(python_path, candidate, sizeof(python_path));
+            return;
+        }
+        path = sep ? sep + 1 : NULL;
+    }
+}
+
+// Ambiente do filho: as variáveis CGI do pedido + as do servidor que elas
+// não substituem. Só ponteiros (o array é libertado pelo caller).
+static char** build_envp(char* const env[]) {
+    int n_env = 0, n_inherited = 0;
+    while (env[n_env]) n_env++;
+    while (environ[n_inherited]) n_inherited++;
+
+    char** envp = malloc(sizeof(char*) * (n_env + n_inherited + 1));
+    if (!envp) return NULL;
+    int n = 0;
+    for (int i = 0; i < n_env; i++) envp[n++] = env[i];
+    for (int i = 0; i < n_inherited; i++) {
+        const char* eq = strchr(environ[i], '=');
+        size_t name_len = eq ? (size_t)(eq - environ[i]) + 1 : strlen(environ[i]);
+        int overridden = 0;
+        for (int j = 0; j < n_env && !overridden; j++) overridden = strncmp(env[j], environ[i], name_len) == 0;
+        if (!overridden) envp[n++] = environ[i];
+    }
+    envp[n] = NULL;
+    return envp;
+}
+
+// Fallback sem pool: um processo python3 novo por pedido.
+// O worker tem várias threads: tudo o que o filho precisa (argv, envp, caminho
+// do python3) é preparado antes do fork, e o filho só chama funções
+// async-signal-safe (dup2, execve, _exit).
+static int open_forked(cgi_stream_t* st, const char* script_path, char* const env[]) {
+    pthread_once(&python_once, resolve_python);
+    char* argv[] = {"python3", (char*)script_path, NULL};
+    char** envp = build_envp(env);
+    if (!envp) return -1;
+
+    // 1. Criar Pipe (O_CLOEXEC: um fork concorrente noutra thread não herda
+    // a ponta de escrita, que atrasaria o EOF deste script)
     int pipefd[2];
-    
-    // 1. Criar Pipe
-    if (pipe(pipefd) == -1) {
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
         perror("CGI pipe error");
-        return 500;
+        free(envp);
+        return -1;
     }
 
     pid_t pid = fork();
 
     if (pid < 0) {
         perror("CGI fork error");
-        return 500;
+        close(pipefd[0]);
+        close(pipefd[1]);
+        free(envp);
+        return -1;
     }
 
     if (pid == 0) {
         // --- PROCESSO FILHO ---
-        close(pipefd[0]); // Fecha leitura
-        
-        // Redirecionar STDOUT para o pipe
+        // Redirecionar STDOUT para o pipe (o dup2 não mantém o O_CLOEXEC)
         dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[1]);
+        execve(python_path, argv, envp);
+        _exit(127); // Sem exec: o pai vê a falha no status
+    }
+
+    // --- PROCESSO PAI ---
+    free(envp);
+    close(pipefd[1]); // Fecha escrita
+    memset(st, 0, sizeof(*st));
+    st->fd = pipefd[0];
+    st->pid = pid;
+    return 0;
+}
+
+// Fim do bloco de headers do script ("\n\n" ou "\r\n\r\n"): offset do corpo ou 0
+static size_t find_header_end(const char* buf, size_t len) {
+    for (size_t i = 0; i + 1 < len; i++) {
+        if (buf[i] != '\n') continue;
+        if (buf[i + 1] == '\n') return i + 2;
+        if (i + 2 < len && buf[i + 1] == '\r' && buf[i + 2] == '\n') return i + 3;
+    }
+    return 0;
+}
+
+// A primeira linha é "Nome: valor"? Scripts antigos escrevem só HTML
+static int starts_with_header(const char* buf, size_t len) {
+    size_t i = 0;
+    while (i < len && (buf[i] == '-' || ((buf[i] | 0x20) >= 'a' && (buf[i] | 0x20) <= 'z'))) i++;
+    return i > 0 && i < len && buf[i] == ':';
+}
+
+typedef struct {
+    int status;
+    char reason[64];
+    char content_type[128];
+    long content_length; // -1: desconhecido
+    char extra[CGI_HEADER_MAX]; // Restantes headers, já com "\r\n"
+    size_t extra_len;
+} cgi_headers_t;
+
+// Headers CGI: Status, Content-Type, Location e Content-Length são
+// interpretados; os restantes passam para a resposta
+static void parse_cgi_headers(const char* p, const char* end, cgi_headers_t* h) {
+    while (p < end) {
+        const char* nl = memchr(p, '\n', end - p);
+        const char* line_end = nl ? nl : end;
+        const char* value_end = (line_end > p && line_end[-1] == '\r') ? line_end - 1 : line_end;
+        const char* colon = memchr(p, ':', value_end - p);
+        if (colon) {
+            size_t name_len = colon - p;
+            const char* v = colon + 1;
+            while (v < value_end && *v == ' ') v++;
+            int vlen = value_end - v;
+
+            if (name_len == 6 && strncasecmp(p, "Status", 6) == 0) {
+                h->status = atoi(v);
+                const char* sp = memchr(v, ' ', vlen);
+                if (sp) snprintf(h->reason, sizeof(h->reason), "%.*s", (int)(value_end - sp - 1), sp + 1);
+            } else if (name_len == 12 && strncasecmp(p, "Content-Type", 12) == 0) {
+                snprintf(h->content_type, sizeof(h->content_type), "%.*s", vlen, v);
+            } else if (name_len == 14 && strncasecmp(p, "Content-Length", 14) == 0) {
+                h->content_length = atol(v);
+            } else if ((name_len == 10 && strncasecmp(p, "Connection", 10) == 0) ||
+                       (name_len == 17 && strncasecmp(p, "Transfer-Encoding", 17) == 0)) {
+                // Framing é decidido pelo servidor
+            } else {
+                if (name_len == 8 && strncasecmp(p, "Location", 8) == 0 && h->status == 200) h->status = 302;
+                int n = snprintf(h->extra + h->extra_len, sizeof(h->extra) - h->extra_len,
+                                 "%.*s\r\n", (int)(value_end - p), p);
+                if (n > 0 && h->extra_len + n < sizeof(h->extra)) h->extra_len += n;
+            }
+        }
+        p = nl ? nl + 1 : end;
+    }
+}
+
+static const char* default_reason(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        default:  return status >= 500 ? "Internal Server Error" : "OK";
+    }
+}
 
-        // Executar o script Python
-        // Assume que o python3 está no PATH
-        execlp("python3", "python3", script_path, NULL);
-        
-        // Se execlp falhar:
-        perror("CGI exec error");
-        exit(1);
-    } 
-    else {
-        // --- PROCESSO PAI ---
-        close(pipefd[1]); // Fecha escrita
-
-        // Ler o output do script
-        char* output_buffer = malloc(65536);
-        if (!output_buffer) {
-            close(pipefd[0]);
-            waitpid(pid, NULL, 0);
-            return 500;
+// Envia um bloco do corpo (em chunked: "<tamanho hex>\r\n" + dados + "\r\n")
+static int relay(int client_fd, const char* data, size_t len, int chunked) {
+    if (len == 0) return 0;
+    if (!chunked) {
+        struct iovec iov = {(void*)data, len};
+        return http_send_iov(client_fd, &iov, 1, 0);
+    }
+    char size_line[20];
+    int size_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    struct iovec iov[3] = {{size_line, size_len}, {(void*)data, len}, {"\r\n", 2}};
+    return http_send_iov(client_fd, iov, 3, 0);
+}
+
+// Junta 'len' bytes à cópia para a micro-cache (desiste acima de CGI_CAPTURE_MAX)
+static void capture_append(cgi_capture_t* cap, const char* data, size_t len) {
+    if (!cap || !cap->cacheable || len == 0) return;
+    if (cap->len + len > CGI_CAPTURE_MAX) {
+        cap->cacheable = 0;
+        return;
+    }
+    if (cap->len + len > cap->size) {
+        size_t size = cap->size ? cap->size : CGI_RELAY_BUFFER;
+        while (size < cap->len + len) size *= 2;
+        char* grown = realloc(cap->data, size);
+        if (!grown) {
+            cap->cacheable = 0;
+            return;
         }
+        cap->data = grown;
+        cap->size = size;
+    }
+    memcpy(cap->data + cap->len, data, len);
+    cap->len += len;
+}
+
+void cgi_capture_free(cgi_capture_t* cap) {
+    free(cap->data);
+    cap->data = NULL;
+    cap->len = cap->size = 0;
+}
+
+int handle_cgi_request(int client_fd, const char* script_path, const char* query, const http_request_t* req,
+                       int* keep_alive, size_t* bytes_sent, cgi_capture_t* capture) {
+    // Ambiente CGI/1.1 (mínimo)
+    char env_script[1100], env_query[HTTP_MAX_PATH + 16], env_method[32], env_protocol[32];
+    snprintf(env_script, sizeof(env_script), "SCRIPT_FILENAME=%s", script_path);
+    snprintf(env_query, sizeof(env_query), "QUERY_STRING=%s", query ? query : "");
+    snprintf(env_method, sizeof(env_method), "REQUEST_METHOD=%.*s", (int)req->method.len, req->method.ptr);
+    snprintf(env_protocol, sizeof(env_protocol), "SERVER_PROTOCOL=%.*s", (int)req->version.len, req->version.ptr);
+    char* env[CGI_ENV_MAX] = {env_script, env_query, env_method, env_protocol,
+                              "GATEWAY_INTERFACE=CGI/1.1", "SERVER_SOFTWARE=ConcurrentHTTP/1.0", NULL};
+    int to_client = client_fd >= 0;
+    if (capture) memset(capture, 0, sizeof(*capture));
 
-        int total_read = 0;
-        int n;
-        while ((n = read(pipefd[0], output_buffer + total_read, 65536 - total_read)) > 0) {
-            total_read += n;
-            if (total_read >= 65536) break; // Buffer cheio
+    // Interpretador do pool; sem pool (ou pool em baixo) fork + exec
+    cgi_stream_t st;
+    if (open_pooled(&st, env) != 0 && open_forked(&st, script_path, env) != 0) return -1;
+
+    // 1. Ler até ao fim dos headers do script (ou até o buffer encher / o script terminar)
+    char head[CGI_HEADER_MAX];
+    size_t len = 0, body_off = 0;
+    int has_headers = 0;
+    ssize_t n;
+    while (len < sizeof(head) && (n = cgi_read(&st, head + len, sizeof(head) - len)) > 0) {
+        len += n;
+        if (!starts_with_header(head, len)) break; // Só corpo (scripts sem headers)
+        if ((body_off = find_header_end(head, len)) > 0) {
+            has_headers = 1;
+            break;
         }
+    }
+    // O que já está à espera no fd (sem bloquear): scripts curtos terminam
+    // aqui e a resposta sai com Content-Length em vez de chunked
+    struct pollfd pfd = {st.fd, POLLIN, 0};
+    while (len < sizeof(head) && !st.done && poll(&pfd, 1, 0) > 0 &&
+           (n = cgi_read(&st, head + len, sizeof(head) - len)) > 0) {
+        len += n;
+    }
+    if (st.done && st.status != 0) { // Falhou antes de se enviar alguma coisa: 500
+        cgi_close(&st);
+        return -1;
+    }
 
-        close(pipefd[0]);
-        
-        // Esperar que o filho morra para evitar Zombies!
-        int status;
-        waitpid(pid, &status, 0);
-
-        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
-            // Sucesso: Enviar resposta HTTP com o output do script
-            send_http_response(client_fd, 200, "OK", "text/html", output_buffer, total_read, 0);
-            free(output_buffer);
-            return 200;
-        } else {
-            // Script falhou
-            free(output_buffer);
-            return 500;
+    cgi_headers_t h = {200, "", "text/html", -1, "", 0};
+    if (has_headers) parse_cgi_headers(head, head + body_off, &h);
+    else body_off = 0;
+    const char* reason = h.reason[0] ? h.reason : default_reason(h.status);
+    int is_head = http_str_eq(req->method, "HEAD");
+
+    // Só respostas 200 sem headers além do Content-Type entram na micro-cache
+    if (capture) {
+        capture->cacheable = h.status == 200 && h.extra_len == 0 &&
+                             strlen(h.content_type) < sizeof(capture->content_type);
+        snprintf(capture->content_type, sizeof(capture->content_type), "%.*s",
+                 (int)sizeof(capture->content_type) - 1, h.content_type);
+    }
+
+    // 2. Framing: tamanho conhecido se o script já terminou ou o indicou;
+    // senão chunked (HTTP/1.1) ou fim marcado pelo fecho da conexão (HTTP/1.0)
+    char length_line[64] = "";
+    int chunked = 0;
+    long content_length = st.done ? (long)(len - body_off) : h.content_length;
+    if (content_length >= 0) {
+        snprintf(length_line, sizeof(length_line), "Content-Length: %ld\r\n", content_length);
+    } else if (http_str_case_eq(req->version, "HTTP/1.1")) {
+        chunked = 1;
+        snprintf(length_line, sizeof(length_line), "Transfer-Encoding: chunked\r\n");
+    } else {
+        *keep_alive = 0;
+    }
+
+    char header[CGI_HEADER_MAX + 512];
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 %d %s\r\n"
+        "Content-Type: %s\r\n"
+        "%s"
+        "%.*s"
+        "Server: ConcurrentHTTP/1.0\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        h.status, reason, h.content_type, length_line, (int)h.extra_len, h.extra,
+        *keep_alive ? "keep-alive" : "close");
+    if (header_len >= (int)sizeof(header)) header_len = sizeof(header) - 1;
+
+    // 3. Header + o que já foi lido do corpo (num só sendmsg se o script já acabou)
+    size_t first = len - body_off;
+    if (content_length >= 0 && first > (size_t)content_length) first = content_length;
+    capture_append(capture, head + body_off, first);
+    int failed;
+    if (!to_client) { // Só captura (refrescar a micro-cache)
+        failed = 0;
+    } else if (is_head) {
+        struct iovec iov = {header, header_len};
+        failed = http_send_iov(client_fd, &iov, 1, 0) < 0;
+    } else if (!chunked) {
+        struct iovec iov[2] = {{header, header_len}, {head + body_off, first}};
+        failed = http_send_iov(client_fd, iov, 2, 0) < 0;
+    } else {
+        struct iovec iov = {header, header_len};
+        failed = http_send_iov(client_fd, &iov, 1, MSG_MORE) < 0 ||
+                 relay(client_fd, head + body_off, first, 1) < 0;
+    }
+    size_t sent = first; // Corpo produzido pelo script (enviado ou só capturado)
+
+    // 4. Resto do output à medida que chega, com memória fixa
+    char buf[CGI_RELAY_BUFFER];
+    while (!failed && (n = cgi_read(&st, buf, sizeof(buf))) > 0) {
+        size_t chunk = n;
+        if (content_length >= 0 && sent + chunk > (size_t)content_length) chunk = content_length - sent;
+        capture_append(capture, buf, chunk);
+        if (is_head || !to_client) { // HEAD: deixar o script terminar, sem corpo
+            sent += chunk;
+            continue;
         }
+        failed = relay(client_fd, buf, chunk, chunked) < 0;
+        sent += chunk;
+    }
+    if (capture && (failed || st.status != 0 || (content_length >= 0 && sent < (size_t)content_length))) {
+        capture->cacheable = 0; // Output incompleto não vai para a cache
     }
-}
\ No newline at end of file
+    if (failed || (st.done && st.status != 0) ||
+        (content_length >= 0 && sent < (size_t)content_length)) {
+        // Resposta incompleta: só fechar a conexão a avisa o cliente
+        *keep_alive = 0;
+    } else if (chunked && !is_head && to_client) {
+        struct iovec end = {"0\r\n\r\n", 5};
+        if (http_send_iov(client_fd, &end, 1, 0) < 0) *keep_alive = 0;
+    }
+
+    cgi_close(&st);
+    *bytes_sent = (is_head || !to_client) ? 0 : sent;
+    return h.status;
+}
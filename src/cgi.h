@@ -2,8 +2,51 @@
 #ifndef CGI_H
 #define CGI_H
 
-// Executa um script e envia a resposta ao cliente
-// Retorna o código de estado HTTP (200 ou 500)
-int handle_cgi_request(int client_fd, const char* script_path);
+#include <stddef.h>
+#include "http.h"
+#include "config.h"
 
-#endif
\ No newline at end of file
+#define CGI_RUNNER_PATH "tools/cgi_runner.py"
+#define CGI_POOL_MAX 64
+
+// Pool de interpretadores persistentes (CGI_POOL_SIZE). O Master cria um
+// socket Unix num diretório privado (0700) e lança os processos python3 que
+// fazem accept() nele; os workers ligam-se por pedido. Os runners só aceitam
+// ligações do mesmo uid e só correm scripts dentro das raízes configuradas
+// (DOCUMENT_ROOT e VHOSTs). Devolve -1 se o pool não arrancou (os pedidos
+// usam então fork + exec).
+int cgi_pool_start(const server_config_t* config);
+
+// Master (a cada segundo): relança os interpretadores que morreram
+void cgi_pool_reap(void);
+
+// Master: termina os interpretadores e fecha o socket
+void cgi_pool_stop(void);
+
+// Worker: fecha a cópia herdada do socket de escuta (só precisa do endereço)
+void cgi_pool_worker_init(void);
+
+// Cópia do corpo de uma resposta CGI para a micro-cache (CGI_CACHE_<path>)
+typedef struct {
+    char* data;            // malloc (libertar com cgi_capture_free)
+    size_t len;
+    size_t size;
+    char content_type[40];
+    int cacheable;         // 200 completo, só com Content-Type e até 1 MB
+} cgi_capture_t;
+
+// Executa um script e reencaminha o output para o cliente à medida que é
+// produzido (chunked quando o tamanho não é conhecido). O script pode
+// começar por headers CGI (Status, Content-Type, Location...) e uma linha
+// vazia; sem eles todo o output é corpo text/html.
+// 'query' vai para QUERY_STRING. Com 'capture' o corpo também é copiado;
+// com client_fd < 0 só é copiado (refrescar a micro-cache sem cliente).
+// Devolve o status HTTP enviado, ou -1 se o script falhou antes de haver
+// resposta (o caller envia o 500). '*keep_alive' passa a 0 se a resposta
+// ficou incompleta ou só pode terminar com o fecho da conexão.
+int handle_cgi_request(int client_fd, const char* script_path, const char* query, const http_request_t* req,
+                       int* keep_alive, size_t* bytes_sent, cgi_capture_t* capture);
+
+void cgi_capture_free(cgi_capture_t* cap);
+
+#endif
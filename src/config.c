@@ -26,6 +26,10 @@ int load_config(const char* filename, server_config_t* config) {
 
             else if (strcmp(key, "THREADS_PER_WORKER") == 0)
                 config->threads_per_worker = atoi(value);
+            else if (strcmp(key, "MIN_THREADS_PER_WORKER") == 0)
+                config->threads_min = atoi(value);
+            else if (strcmp(key, "THREAD_IDLE_TIMEOUT") == 0)
+                config->thread_idle_timeout = atoi(value);
 
             else if (strcmp(key, "DOCUMENT_ROOT") == 0)
                 strncpy(config->document_root,
@@ -40,6 +44,35 @@ int load_config(const char* filename, server_config_t* config) {
                 config->cache_size_mb = atoi(value);
             else if (strcmp(key, "TIMEOUT_SECONDS") == 0)
                 config->timeout_seconds = atoi(value);
+            else if (strcmp(key, "REUSE_PORT") == 0)
+                config->reuse_port = atoi(value);
+            else if (strcmp(key, "REBALANCE") == 0)
+                config->rebalance = atoi(value);
+            else if (strcmp(key, "SHARED_CACHE") == 0)
+                config->shared_cache = atoi(value);
+            else if (strcmp(key, "JOURNAL_ENTRIES") == 0)
+                config->journal_entries = atoi(value);
+            else if (strcmp(key, "OPEN_FILE_CACHE") == 0)
+                config->open_file_cache = atoi(value);
+            else if (strcmp(key, "OPEN_FILE_REVALIDATE") == 0)
+                config->open_file_revalidate = atoi(value);
+            else if (strcmp(key, "GZIP") == 0)
+                config->gzip = atoi(value);
+            else if (strcmp(key, "GZIP_MIN_LENGTH") == 0)
+                config->gzip_min_length = atoi(value);
+            else if (strcmp(key, "CGI_POOL_SIZE") == 0)
+                config->cgi_pool_size = atoi(value);
+            else if (strcmp(key, "CGI_TIMEOUT") == 0)
+                config->cgi_timeout = atoi(value);
+            else if (strcmp(key, "CGI_CACHE_STALE") == 0)
+                config->cgi_cache_stale = atoi(value);
+            else if (strncmp(key, "CGI_CACHE_", 10) == 0) {
+                if (config->cgi_cache_count < 10) {
+                    strncpy(config->cgi_cache[config->cgi_cache_count].path, key + 10, 255);
+                    config->cgi_cache[config->cgi_cache_count].ttl = atoi(value);
+                    config->cgi_cache_count++;
+                }
+            }
             else if (strncmp(key, "VHOST_", 6) == 0) {
                 if (config->vhost_count < 10) {
                     strncpy(config->vhosts[config->vhost_count].hostname, key + 6, 127);
@@ -7,15 +7,36 @@ typedef struct {
     char root[256];
 } vhost_t;
 
+// Micro-cache CGI por rota: CGI_CACHE_<path>=<ttl em segundos>
+typedef struct {
+    char path[256];
+    int ttl;
+} cgi_cache_rule_t;
+
 typedef struct {
     int port;
     char document_root[256];
     int num_workers;
-    int threads_per_worker;
+    int threads_per_worker;  // Máximo de threads da pool de cada worker
+    int threads_min;         // Threads sempre vivas (MIN_THREADS_PER_WORKER; 0 = pool fixa)
+    int thread_idle_timeout; // Segundos sem trabalho até uma thread acima do mínimo terminar
     int max_queue_size;
     char log_file[256];
     int cache_size_mb;
     int timeout_seconds;
+    int reuse_port;      // 1 = um socket SO_REUSEPORT por worker (sem mutex no accept)
+    int rebalance;       // 1 = workers saturados entregam conexões novas a outro worker
+    int shared_cache;    // 1 = uma única cache em SHM para todos os workers
+    int journal_entries; // Registos no journal binário (0 = desligado)
+    int open_file_cache;      // Máximo de ficheiros abertos em cache por worker (0 = desligado)
+    int open_file_revalidate; // Segundos até voltar a confirmar o ficheiro com stat()
+    int gzip;                 // 1 = negociar Content-Encoding: gzip (sidecars .gz ou compressão em cache)
+    int gzip_min_length;      // Ficheiros mais pequenos seguem sem compressão
+    int cgi_pool_size;        // Interpretadores python3 persistentes (0 = fork + exec por pedido)
+    int cgi_timeout;          // Segundos até um script CGI ser interrompido
+    cgi_cache_rule_t cgi_cache[10];
+    int cgi_cache_count;
+    int cgi_cache_stale;      // Segundos depois do TTL em que a cópia antiga ainda serve (durante o refresh)
     vhost_t vhosts[10]; 
     int vhost_count;
 } server_config_t;
@@ -0,0 +1,167 @@
+// src/event_loop.c
+#define _POSIX_C_SOURCE 200809L
+#include "event_loop.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+event_loop_t* event_loop_create(int listen_fd) {
+    event_loop_t* loop = malloc(sizeof(event_loop_t));
+    if (!loop) return NULL;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        free(loop);
+        return NULL;
+    }
+
+    loop->listen_fd = listen_fd;
+    loop->conns = NULL;
+    loop->num_conns = 0;
+    pthread_mutex_init(&loop->lock, NULL);
+
+    // Socket de escuta: data.ptr == NULL identifica-o no loop.
+    // EPOLLEXCLUSIVE evita acordar todos os workers para a mesma conexão.
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+        perror("epoll_ctl listen");
+        close(loop->epoll_fd);
+        pthread_mutex_destroy(&loop->lock);
+        free(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+connection_t* event_loop_add(event_loop_t* loop, int client_fd) {
+    connection_t* conn = malloc(sizeof(connection_t));
+    if (!conn) {
+        close(client_fd);
+        return NULL;
+    }
+
+    // Incrementar Active Connections (uma vez por cliente)
+    stats_connection_opened();
+
+    conn->fd = client_fd;
+    conn->buf = NULL;
+    conn->buf_len = 0;
+    conn->scanned = 0;
+    conn->state = CONN_IDLE;
+    conn->last_active = time(NULL);
+    conn->prev = NULL;
+
+    pthread_mutex_lock(&loop->lock);
+    conn->next = loop->conns;
+    if (loop->conns) loop->conns->prev = conn;
+    loop->conns = conn;
+    loop->num_conns++;
+
+    // EPOLLONESHOT: cada pedido é entregue a uma única thread
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    int rc = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+    pthread_mutex_unlock(&loop->lock);
+
+    if (rc < 0) {
+        perror("epoll_ctl add");
+        event_loop_close(loop, conn);
+        return NULL;
+    }
+
+    return conn;
+}
+
+void event_loop_claim(event_loop_t* loop, connection_t* conn) {
+    pthread_mutex_lock(&loop->lock);
+    conn->state = CONN_BUSY;
+    pthread_mutex_unlock(&loop->lock);
+}
+
+void event_loop_rearm(event_loop_t* loop, connection_t* conn) {
+    pthread_mutex_lock(&loop->lock);
+    conn->state = CONN_IDLE;
+    conn->last_active = time(NULL);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    int rc = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    pthread_mutex_unlock(&loop->lock);
+
+    if (rc < 0) event_loop_close(loop, conn);
+}
+
+// Nota: Assume que o lock do loop já está adquirido!
+static void unlink_connection(event_loop_t* loop, connection_t* conn) {
+    if (conn->prev) conn->prev->next = conn->next;
+    else loop->conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    loop->num_conns--;
+
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+}
+
+static void free_connection(connection_t* conn) {
+    free(conn->buf);
+    free(conn);
+}
+
+void event_loop_close(event_loop_t* loop, connection_t* conn) {
+    pthread_mutex_lock(&loop->lock);
+    unlink_connection(loop, conn);
+    pthread_mutex_unlock(&loop->lock);
+    free_connection(conn);
+
+    // Decrementar Active Connections ao sair
+    stats_connection_closed(1);
+}
+
+void event_loop_sweep(event_loop_t* loop) {
+    time_t now = time(NULL);
+    int closed = 0;
+
+    pthread_mutex_lock(&loop->lock);
+    connection_t* current = loop->conns;
+    while (current) {
+        connection_t* next = current->next;
+        // Só as conexões IDLE podem expirar (as BUSY pertencem a uma thread)
+        if (current->state == CONN_IDLE && now - current->last_active >= KEEPALIVE_TIMEOUT) {
+            unlink_connection(loop, current);
+            free_connection(current);
+            closed++;
+        }
+        current = next;
+    }
+    pthread_mutex_unlock(&loop->lock);
+
+    stats_connection_closed(closed);
+}
+
+void event_loop_destroy(event_loop_t* loop) {
+    if (!loop) return;
+
+    // Chamado depois da thread pool terminar: já não há conexões BUSY
+    int closed = 0;
+    pthread_mutex_lock(&loop->lock);
+    while (loop->conns) {
+        connection_t* conn = loop->conns;
+        unlink_connection(loop, conn);
+        free_connection(conn);
+        closed++;
+    }
+    pthread_mutex_unlock(&loop->lock);
+
+    stats_connection_closed(closed);
+
+    close(loop->epoll_fd);
+    pthread_mutex_destroy(&loop->lock);
+    free(loop);
+}
@@ -0,0 +1,63 @@
+// src/event_loop.h
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <pthread.h>
+#include <time.h>
+
+#define KEEPALIVE_TIMEOUT 5 // segundos
+#define MAX_EVENTS 256
+#define CONN_BUFFER_SIZE 8192 // Máximo de um pedido (linha + headers + corpo)
+
+typedef enum {
+    CONN_IDLE, // Registada no epoll, à espera de dados
+    CONN_BUSY  // Entregue a uma thread da pool
+} conn_state_t;
+
+// Estado de uma conexão keep-alive.
+// Enquanto está inativa custa apenas esta estrutura (não ocupa nenhuma thread).
+typedef struct connection {
+    int fd;
+    conn_state_t state;
+    time_t last_active;
+
+    // Bytes recebidos mas ainda não servidos (pedido parcial ou pipeline).
+    // Só é alocado quando sobram dados entre leituras; NULL no caso comum.
+    char* buf;
+    size_t buf_len;
+    size_t scanned; // Progresso do parser em 'buf'
+
+    struct connection* next;
+    struct connection* prev;
+} connection_t;
+
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+
+    // Lista de todas as conexões abertas (para o timeout de keep-alive)
+    connection_t* conns;
+    int num_conns;
+    pthread_mutex_t lock;
+} event_loop_t;
+
+event_loop_t* event_loop_create(int listen_fd);
+
+// Regista uma conexão aceite (fica IDLE, à espera de dados)
+connection_t* event_loop_add(event_loop_t* loop, int client_fd);
+
+// Marca a conexão como BUSY antes de a entregar à thread pool
+void event_loop_claim(event_loop_t* loop, connection_t* conn);
+
+// Volta a armar a conexão no epoll depois de um pedido keep-alive
+void event_loop_rearm(event_loop_t* loop, connection_t* conn);
+
+// Remove a conexão do epoll, fecha o socket e liberta a estrutura
+void event_loop_close(event_loop_t* loop, connection_t* conn);
+
+// Fecha conexões IDLE há mais de KEEPALIVE_TIMEOUT segundos
+void event_loop_sweep(event_loop_t* loop);
+
+void event_loop_destroy(event_loop_t* loop);
+
+#endif
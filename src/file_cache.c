@@ -0,0 +1,245 @@
+// src/file_cache.c
+#define _POSIX_C_SOURCE 200809L
+#include "file_cache.h"
+#include "http.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+static size_t hash_key(const char* key) {
+    size_t h = 14695981039346656037ULL;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void entry_unref(file_entry_t* e) {
+    if (atomic_fetch_sub(&e->refs, 1) == 1) {
+        close(e->fd);
+        free(e->path);
+        free(e);
+    }
+}
+
+// --- Índice + LRU ---
+// Nota: Todas as funções abaixo assumem que o lock já está adquirido!
+
+static file_entry_t* find_entry(file_cache_t* fc, const char* path, size_t hash, int gzip) {
+    file_entry_t* e = fc->buckets[hash & (fc->num_buckets - 1)];
+    while (e) {
+        if (e->hash == hash && e->gzip == gzip && strcmp(e->path, path) == 0) return e;
+        e = e->hnext;
+    }
+    return NULL;
+}
+
+static void lru_unlink(file_cache_t* fc, file_entry_t* e) {
+    if (e->prev) e->prev->next = e->next;
+    else fc->lru_head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else fc->lru_tail = e->prev;
+}
+
+static void lru_push_front(file_cache_t* fc, file_entry_t* e) {
+    e->prev = NULL;
+    e->next = fc->lru_head;
+    if (fc->lru_head) fc->lru_head->prev = e;
+    fc->lru_head = e;
+    if (!fc->lru_tail) fc->lru_tail = e;
+}
+
+// Retira do índice e larga a referência da cache (o fd fecha quando o
+// último pedido que o está a usar terminar)
+static void remove_entry(file_cache_t* fc, file_entry_t* e) {
+    file_entry_t** link = &fc->buckets[e->hash & (fc->num_buckets - 1)];
+    while (*link && *link != e) link = &(*link)->hnext;
+    if (*link) *link = e->hnext;
+
+    lru_unlink(fc, e);
+    e->cached = 0;
+    fc->count--;
+    entry_unref(e);
+}
+
+static void insert_entry(file_cache_t* fc, file_entry_t* e) {
+    size_t idx = e->hash & (fc->num_buckets - 1);
+    e->hnext = fc->buckets[idx];
+    fc->buckets[idx] = e;
+    lru_push_front(fc, e);
+    e->cached = 1;
+    fc->count++;
+
+    while (fc->count > fc->max_entries) remove_entry(fc, fc->lru_tail);
+}
+
+// --- API ---
+
+file_cache_t* file_cache_create(int max_entries, int revalidate_secs) {
+    file_cache_t* fc = malloc(sizeof(file_cache_t));
+    if (!fc) return NULL;
+
+    fc->max_entries = (max_entries > 0) ? max_entries : 0;
+    fc->revalidate_secs = revalidate_secs;
+    fc->count = 0;
+    fc->lru_head = fc->lru_tail = NULL;
+
+    // Ocupação máxima de 50%
+    fc->num_buckets = 16;
+    while (fc->num_buckets < (size_t)fc->max_entries * 2) fc->num_buckets <<= 1;
+    fc->buckets = calloc(fc->num_buckets, sizeof(file_entry_t*));
+    if (!fc->buckets) {
+        free(fc);
+        return NULL;
+    }
+    pthread_mutex_init(&fc->lock, NULL);
+    return fc;
+}
+
+static int same_file(const file_entry_t* e, const struct stat* st) {
+    return e->inode == st->st_ino && e->dev == st->st_dev &&
+           e->mtime == st->st_mtime && e->mtime_nsec == st->st_mtim.tv_nsec &&
+           e->size == st->st_size;
+}
+
+// Abre o ficheiro e prepara uma entrada nova (fora do lock)
+static file_entry_t* open_entry(const char* path, size_t hash, time_t now, int gzip) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        errno = ENOENT; // Diretorias e afins tratam-se como 404
+        return NULL;
+    }
+
+    file_entry_t* e = malloc(sizeof(file_entry_t));
+    if (!e || !(e->path = strdup(path))) {
+        free(e);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    e->hash = hash;
+    e->fd = fd;
+    e->size = st.st_size;
+    e->mtime = st.st_mtime;
+    e->mtime_nsec = st.st_mtim.tv_nsec;
+    e->inode = st.st_ino;
+    e->dev = st.st_dev;
+    e->gzip = gzip;
+    e->validated = now;
+    e->cached = 0;
+    atomic_init(&e->refs, 1); // Referência do caller
+
+    // ETag forte: muda sempre que o ficheiro é substituído ou alterado
+    cache_meta_t* m = &e->meta;
+    snprintf(m->etag, sizeof(m->etag), "\"%lx-%llx-%llx\"", (unsigned long)st.st_ino,
+             (unsigned long long)st.st_size,
+             (unsigned long long)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec);
+    struct tm tm_info;
+    gmtime_r(&st.st_mtime, &tm_info);
+    strftime(m->last_modified, sizeof(m->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm_info);
+    m->mtime = st.st_mtime;
+    m->gzip = gzip;
+
+    // A variante .gz tem o tipo do original (sem a extensão .gz)
+    char original[1024];
+    snprintf(original, sizeof(original), "%s", path);
+    if (gzip && strlen(original) > 3) original[strlen(original) - 3] = '\0';
+    snprintf(m->mime, sizeof(m->mime), "%s", get_mime_type(original));
+
+    e->header_len = snprintf(e->header, sizeof(e->header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %lld\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "%s%s"
+        "Server: ConcurrentHTTP/1.0\r\n",
+        m->mime, (long long)e->size, m->etag, m->last_modified,
+        http_compressible(m->mime) ? "Vary: Accept-Encoding\r\n" : "",
+        gzip ? "Content-Encoding: gzip\r\n" : "");
+    return e;
+}
+
+static file_entry_t* open_variant(file_cache_t* fc, const char* path, int gzip) {
+    size_t hash = hash_key(path);
+    time_t now = time(NULL);
+
+    // 1. Procurar no índice; entradas recentes servem-se sem syscalls
+    pthread_mutex_lock(&fc->lock);
+    file_entry_t* e = find_entry(fc, path, hash, gzip);
+    if (e) {
+        atomic_fetch_add(&e->refs, 1);
+        lru_unlink(fc, e);
+        lru_push_front(fc, e);
+        int fresh = now - e->validated < fc->revalidate_secs;
+        pthread_mutex_unlock(&fc->lock);
+        if (fresh) return e;
+
+        // 2. Revalidar: o path ainda aponta para o mesmo ficheiro, sem alterações?
+        struct stat st;
+        if (stat(path, &st) == 0 && same_file(e, &st)) {
+            pthread_mutex_lock(&fc->lock);
+            e->validated = now;
+            pthread_mutex_unlock(&fc->lock);
+            return e;
+        }
+
+        // Mudou ou desapareceu: descartar e voltar a abrir
+        pthread_mutex_lock(&fc->lock);
+        if (e->cached) remove_entry(fc, e);
+        pthread_mutex_unlock(&fc->lock);
+        entry_unref(e);
+    } else {
+        pthread_mutex_unlock(&fc->lock);
+    }
+
+    // 3. Miss: abrir fora do lock e publicar
+    e = open_entry(path, hash, now, gzip);
+    if (!e || fc->max_entries == 0) return e;
+
+    pthread_mutex_lock(&fc->lock);
+    file_entry_t* old = find_entry(fc, path, hash, gzip); // Outra thread abriu entretanto
+    if (old) remove_entry(fc, old);
+    atomic_fetch_add(&e->refs, 1); // Referência da cache
+    insert_entry(fc, e);
+    pthread_mutex_unlock(&fc->lock);
+    return e;
+}
+
+file_entry_t* file_cache_open(file_cache_t* fc, const char* path) {
+    return open_variant(fc, path, 0);
+}
+
+file_entry_t* file_cache_open_gzip(file_cache_t* fc, const char* path) {
+    char gz_path[1024];
+    if ((size_t)snprintf(gz_path, sizeof(gz_path), "%s.gz", path) >= sizeof(gz_path)) {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    return open_variant(fc, gz_path, 1);
+}
+
+void file_cache_release(file_cache_t* fc, file_entry_t* entry) {
+    (void)fc;
+    if (entry) entry_unref(entry);
+}
+
+void file_cache_destroy(file_cache_t* fc) {
+    if (!fc) return;
+    pthread_mutex_lock(&fc->lock);
+    while (fc->lru_head) remove_entry(fc, fc->lru_head);
+    pthread_mutex_unlock(&fc->lock);
+    pthread_mutex_destroy(&fc->lock);
+    free(fc->buckets);
+    free(fc);
+}
@@ -0,0 +1,67 @@
+// src/file_cache.h
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <time.h>
+#include "cache.h" // cache_meta_t
+
+// Cache de ficheiros abertos (por worker): guarda o fd e os metadados de
+// cada path servido, para os pedidos seguintes não repetirem open/fstat,
+// a deteção do MIME type nem a formatação do header.
+// O fd é partilhado pelas threads: só se usa com offsets explícitos
+// (pread/sendfile), nunca com a posição do ficheiro.
+
+typedef struct file_entry {
+    char* path;
+    size_t hash;
+    int fd;
+    off_t size;
+    time_t mtime;
+    long mtime_nsec;
+    ino_t inode;
+    dev_t dev;
+    int gzip;                // Variante pré-comprimida (path é o "ficheiro.gz")
+    cache_meta_t meta;       // ETag, Last-Modified e MIME (copiados para a cache de conteúdo)
+
+    // "HTTP/1.1 200 OK" + Content-Type + Content-Length + ETag + Last-Modified
+    // [+ Vary + Content-Encoding] + Server, sem a linha Connection nem a linha vazia final
+    char header[384];
+    size_t header_len;
+
+    time_t validated;        // Último stat() que confirmou o ficheiro
+    atomic_int refs;         // Cache + pedidos em curso
+    int cached;              // Ainda está no índice
+    struct file_entry* hnext;
+    struct file_entry* prev; // Lista LRU
+    struct file_entry* next;
+} file_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    file_entry_t** buckets;
+    size_t num_buckets;
+    file_entry_t* lru_head; // Mais recente
+    file_entry_t* lru_tail;
+    int count;
+    int max_entries;        // 0 = sem cache (abre sempre)
+    int revalidate_secs;
+} file_cache_t;
+
+file_cache_t* file_cache_create(int max_entries, int revalidate_secs);
+
+// Devolve a entrada do ficheiro regular em 'path' (com uma referência) ou
+// NULL com errno (ENOENT para ficheiros inexistentes e diretorias, EACCES...)
+file_entry_t* file_cache_open(file_cache_t* fc, const char* path);
+
+// Variante pré-comprimida de 'path' (o ficheiro "path.gz" ao lado do original):
+// o MIME é o do original e o header já leva Content-Encoding: gzip
+file_entry_t* file_cache_open_gzip(file_cache_t* fc, const char* path);
+
+void file_cache_release(file_cache_t* fc, file_entry_t* entry);
+
+void file_cache_destroy(file_cache_t* fc);
+
+#endif
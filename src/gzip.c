@@ -0,0 +1,33 @@
+// src/gzip.c
+#include "gzip.h"
+#include <stdlib.h>
+#include <zlib.h>
+
+void* gzip_compress(const void* data, size_t len, size_t* out_len) {
+    z_stream zs = {0};
+    // windowBits 15 + 16: header e trailer gzip em vez de zlib
+    if (deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+
+    // deflateBound cabe sempre numa única chamada com Z_FINISH
+    size_t bound = deflateBound(&zs, len);
+    unsigned char* out = malloc(bound);
+    if (!out) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+
+    zs.next_in = (unsigned char*)data;
+    zs.avail_in = len;
+    zs.next_out = out;
+    zs.avail_out = bound;
+    int rc = deflate(&zs, Z_FINISH);
+    size_t produced = zs.total_out;
+    deflateEnd(&zs);
+
+    if (rc != Z_STREAM_END || produced >= len) {
+        free(out);
+        return NULL;
+    }
+    *out_len = produced;
+    return out;
+}
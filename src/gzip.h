@@ -0,0 +1,12 @@
+// src/gzip.h
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <stddef.h>
+
+// Comprime 'len' bytes no formato gzip (zlib, nível 6).
+// Devolve um buffer alocado com malloc (o caller faz free) e o tamanho em
+// '*out_len', ou NULL se falhar ou se o resultado não for mais pequeno.
+void* gzip_compress(const void* data, size_t len, size_t* out_len);
+
+#endif
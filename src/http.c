@@ -1,97 +1,509 @@
 // src/http.c
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "http.h"
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h> 
 #include <strings.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <limits.h>
 
 // =========================
 // 6. HTTP Request Parser
 // =========================
 
-int parse_http_request(const char* buffer, http_request_t* req) {
-    // 1. Limpar o host por defeito
-    req->host[0] = '\0';
-    req->range_start = -1;
-    req->range_end = -1;
-    req->connection_close = 0;
+// --- Scanner de delimitadores ---
+// Procura o primeiro byte igual a 'a' ou 'b' em [p, end). As versões SIMD
+// comparam 16 (SSE2) ou 32 (AVX2) bytes de cada vez; a escolha é feita uma
+// vez no arranque conforme o CPU.
+typedef const char* (*scan_fn)(const char* p, const char* end, char a, char b);
 
-    // 2. Parse da primeira linha (Método, Path, Versão)
-    char* line_end = strstr(buffer, "\r\n");
-    if (!line_end) return -1;
+static const char* scan_scalar(const char* p, const char* end, char a, char b) {
+    for (; p < end; p++) {
+        if (*p == a || *p == b) return p;
+    }
+    return NULL;
+}
 
-    char first_line[1024];
-    size_t len = line_end - buffer;
-    if (len >= sizeof(first_line)) len = sizeof(first_line) - 1;
-    strncpy(first_line, buffer, len);
-    first_line[len] = '\0';
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
 
-    if (sscanf(first_line, "%15s %511s %15s", req->method, req->path, req->version) != 3) {
-        return -1;
+__attribute__((target("sse2")))
+static const char* scan_sse2(const char* p, const char* end, char a, char b) {
+    __m128i va = _mm_set1_epi8(a);
+    __m128i vb = _mm_set1_epi8(b);
+    for (; p + 16 <= end; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if (mask) return p + __builtin_ctz(mask);
     }
+    return scan_scalar(p, end, a, b);
+}
 
-    // 3. Loop para encontrar o cabeçalho "Host:"
-    char* current = line_end + 2; // Saltar o primeiro \r\n
-    while (current && *current) {
-        char* next_line = strstr(current, "\r\n");
-        if (!next_line) break;
-
-        // Verificar se a linha começa por "Host:"
-        if (strncasecmp(current, "Host:", 5) == 0) {
-            char* val_start = current + 5;
-            while (*val_start == ' ') val_start++; // Saltar espaços
-            
-            size_t val_len = next_line - val_start;
-            
-            if (val_len >= sizeof(req->host)) val_len = sizeof(req->host) - 1;
-            
-            strncpy(req->host, val_start, val_len);
-            req->host[val_len] = '\0';
-            
-            // Remover porta se existir (ex: localhost:8080 -> localhost)
-            char* port_sep = strchr(req->host, ':');
-            if (port_sep) *port_sep = '\0';
-            
-        }
-        else if (strncasecmp(current, "Range:", 6) == 0) {
-            char* val_start = current + 6;
-            // Procura "bytes="
-            char* bytes_prefix = strstr(val_start, "bytes=");
-            if (bytes_prefix) {
-                // Tenta ler "bytes=START-END"
-                if (sscanf(bytes_prefix, "bytes=%ld-%ld", &req->range_start, &req->range_end) != 2) {
-                     // Se falhar, tenta ler "bytes=START-" (até ao fim)
-                     sscanf(bytes_prefix, "bytes=%ld-", &req->range_start);
-                     req->range_end = -1; // -1 indica até ao fim do ficheiro
-                }
+__attribute__((target("avx2")))
+static const char* scan_avx2(const char* p, const char* end, char a, char b) {
+    __m256i va = _mm256_set1_epi8(a);
+    __m256i vb = _mm256_set1_epi8(b);
+    for (; p + 32 <= end; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if (mask) return p + __builtin_ctz(mask);
+    }
+    // Resto (< 32 bytes) ainda dentro desta função: chamar código SSE sem
+    // codificação VEX com os registos ymm sujos custa a transição AVX-SSE
+    if (p + 16 <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm256_castsi256_si128(va)),
+                                                  _mm_cmpeq_epi8(v, _mm256_castsi256_si128(vb))));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    for (; p < end; p++) {
+        if (*p == a || *p == b) return p;
+    }
+    return NULL;
+}
+#endif
+
+static scan_fn scan = scan_scalar;
+static const char* scan_name = "scalar";
+
+int http_scanner_select(const char* name) {
+    if (strcmp(name, "scalar") == 0) {
+        scan = scan_scalar;
+        scan_name = "scalar";
+        return 0;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        scan = scan_sse2;
+        scan_name = "sse2";
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        scan = scan_avx2;
+        scan_name = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char* http_scanner_name(void) {
+    return scan_name;
+}
+
+// --- Tabela de headers conhecidos ---
+// Indexada por [tamanho][primeira letra]: normalmente um único strncasecmp
+// confirma o header, em vez de uma cadeia de comparações por cada linha.
+typedef enum {
+    HDR_UNKNOWN = 0,
+    HDR_HOST,
+    HDR_RANGE,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_ACCEPT_ENCODING,
+    HDR_IF_RANGE,
+    HDR_TRANSFER_ENCODING
+} header_id_t;
+
+static const struct {
+    const char* name;
+    header_id_t id;
+} known_headers[] = {
+    {"Host", HDR_HOST},
+    {"Range", HDR_RANGE},
+    {"Connection", HDR_CONNECTION},
+    {"Content-Length", HDR_CONTENT_LENGTH},
+    {"If-None-Match", HDR_IF_NONE_MATCH},
+    {"If-Modified-Since", HDR_IF_MODIFIED_SINCE},
+    {"Accept-Encoding", HDR_ACCEPT_ENCODING},
+    {"If-Range", HDR_IF_RANGE},
+    {"Transfer-Encoding", HDR_TRANSFER_ENCODING},
+};
+
+#define NUM_KNOWN_HEADERS (sizeof(known_headers) / sizeof(known_headers[0]))
+#define HDR_MAX_LEN 32
+
+static unsigned char header_table[HDR_MAX_LEN][32]; // Índice + 1 (0 = nenhum)
+static unsigned char header_chain[NUM_KNOWN_HEADERS]; // Próximo com a mesma entrada
+
+static header_id_t lookup_header(const char* name, size_t len) {
+    if (len == 0 || len >= HDR_MAX_LEN) return HDR_UNKNOWN;
+    for (int i = header_table[len][(name[0] | 0x20) & 31]; i; i = header_chain[i - 1]) {
+        if (strncasecmp(name, known_headers[i - 1].name, len) == 0) return known_headers[i - 1].id;
+    }
+    return HDR_UNKNOWN;
+}
+
+// Corre antes do main(): preenche a tabela e escolhe o melhor scanner
+__attribute__((constructor))
+static void http_parser_init(void) {
+    for (size_t i = 0; i < NUM_KNOWN_HEADERS; i++) {
+        const char* name = known_headers[i].name;
+        unsigned char* slot = &header_table[strlen(name)][(name[0] | 0x20) & 31];
+        header_chain[i] = *slot;
+        *slot = i + 1;
+    }
+
+    if (http_scanner_select("avx2") != 0 && http_scanner_select("sse2") != 0) {
+        http_scanner_select("scalar");
+    }
+}
+
+int http_str_eq(http_str_t s, const char* lit) {
+    size_t n = strlen(lit);
+    return s.len == n && memcmp(s.ptr, lit, n) == 0;
+}
+
+int http_str_case_eq(http_str_t s, const char* lit) {
+    size_t n = strlen(lit);
+    return s.len == n && strncasecmp(s.ptr, lit, n) == 0;
+}
+
+// Próximo token até 'delim' (dentro de [p, end)); avança *p para depois dele
+static int next_token(const char** p, const char* end, char delim, http_str_t* out) {
+    const char* start = *p;
+    const char* d = scan(start, end, delim, delim);
+    if (!d || d == start) return -1;
+    out->ptr = start;
+    out->len = d - start;
+    *p = d + 1;
+    return 0;
+}
+
+// Número decimal sem sinal em [p, end); -1 se não houver dígitos.
+// Satura em LONG_MAX em vez de dar a volta (Content-Length gigante).
+static long parse_number(const char** p, const char* end) {
+    long value = 0;
+    const char* start = *p;
+    while (*p < end && **p >= '0' && **p <= '9') {
+        int digit = **p - '0';
+        value = (value > (LONG_MAX - digit) / 10) ? LONG_MAX : value * 10 + digit;
+        (*p)++;
+    }
+    return (*p == start) ? -1 : value;
+}
+
+// Accept-Encoding: lista de "coding[;q=x]". Aceita gzip ou x-gzip; "*"
+// só conta se gzip não aparecer. q=0 é uma recusa explícita.
+static int accepts_gzip(const char* p, const char* end) {
+    int gzip = -1, star = -1; // -1 = ausente, 0 = recusado, 1 = aceite
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == ',')) p++;
+        const char* name = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ') p++;
+        size_t name_len = p - name;
+
+        const char* item_end = p;
+        while (item_end < end && *item_end != ',') item_end++;
+        const char* q = p;
+        while (q < item_end && (*q == ' ' || *q == ';')) q++;
+        int accepted = 1;
+        if (item_end - q >= 3 && (q[0] == 'q' || q[0] == 'Q') && q[1] == '=') {
+            accepted = 0; // "q=0", "q=0.0", "q=0.000"
+            for (const char* d = q + 2; d < item_end && *d != ' '; d++) {
+                if (*d != '0' && *d != '.') accepted = 1;
             }
         }
+        p = item_end;
+
+        if ((name_len == 4 && strncasecmp(name, "gzip", 4) == 0) ||
+            (name_len == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            gzip = accepted;
+        } else if (name_len == 1 && *name == '*') {
+            star = accepted;
+        }
+    }
+    return (gzip >= 0) ? gzip : (star > 0);
+}
+
+long parse_http_request(const char* buffer, size_t len, size_t* scanned, http_request_t* req) {
+    const char* end = buffer + len;
+
+    // 1. Procurar o fim dos headers a partir de onde a última chamada parou
+    size_t from = (*scanned > 3) ? *scanned - 3 : 0;
+    const char* headers_end = NULL;
+    for (const char* p = buffer + from; (p = scan(p, end, '\r', '\r')) != NULL; p++) {
+        if (p + 4 > end) break;
+        if (memcmp(p, "\r\n\r\n", 4) == 0) {
+            headers_end = p;
+            break;
+        }
+    }
+    if (!headers_end) {
+        *scanned = len;
+        return 0; // Headers incompletos: esperar por mais dados
+    }
+
+    memset(req, 0, sizeof(*req));
+    req->reject_status = 400;
+    int has_length = 0, has_encoding = 0;
+
+    // 2. Primeira linha (Método, Path, Versão). Todas as linhas acabam em
+    // CRLF: um CR solto não pode fazer o parse saltar o fim dos headers
+    const char* p = buffer;
+    const char* line_end = scan(p, headers_end + 1, '\r', '\r');
+    if (!line_end || line_end[1] != '\n') return -1;
+    if (next_token(&p, line_end, ' ', &req->method) != 0) return -1;
+    if (next_token(&p, line_end, ' ', &req->path) != 0) return -1;
+    req->version.ptr = p;
+    req->version.len = line_end - p;
+    if (req->version.len == 0 || memchr(p, ' ', req->version.len)) return -1;
+    if (req->method.len > HTTP_MAX_METHOD || req->path.len > HTTP_MAX_PATH) return -1;
+
+    // 3. Headers: uma só passagem encontra o ':' ou o fim da linha. A última
+    // linha acaba no CRLF em headers_end (sem headers, o ciclo não corre)
+    const char* current = line_end + 2;
+    while (current < headers_end) {
+        const char* delim = scan(current, headers_end + 1, ':', '\r');
+        if (!delim) return -1;
+        if (*delim == '\r') { // Linha sem ':' (ignorada)
+            if (delim[1] != '\n') return -1;
+            current = delim + 2;
+            continue;
+        }
+        const char* next_line = scan(delim, headers_end + 1, '\r', '\r');
+        if (!next_line || next_line[1] != '\n') return -1;
+        const char* val = delim + 1;
+        while (val < next_line && *val == ' ') val++;
 
-        else if (strncasecmp(current, "Connection:", 11) == 0) {
-            char* val_start = current + 11;
-            while (*val_start == ' ') val_start++;
-            if (strncasecmp(val_start, "close", 5) == 0) {
-                req->connection_close = 1;
+        switch (lookup_header(current, delim - current)) {
+            case HDR_HOST: {
+                // Remover porta se existir (ex: localhost:8080 -> localhost)
+                const char* port_sep = memchr(val, ':', next_line - val);
+                req->host.ptr = val;
+                req->host.len = (port_sep ? port_sep : next_line) - val;
+                break;
+            }
+            case HDR_RANGE:
+                req->range.ptr = val;
+                req->range.len = next_line - val;
+                break;
+            case HDR_IF_RANGE:
+                req->if_range.ptr = val;
+                req->if_range.len = next_line - val;
+                break;
+            case HDR_CONNECTION:
+                if (next_line - val >= 5 && strncasecmp(val, "close", 5) == 0) {
+                    req->connection_close = 1;
+                }
+                break;
+            case HDR_CONTENT_LENGTH: {
+                long cl = parse_number(&val, next_line);
+                while (val < next_line && *val == ' ') val++;
+                if (cl < 0 || val != next_line) return -1;
+                // Dois valores diferentes: cada intermediário podia escolher um
+                if (has_length && (size_t)cl != req->content_length) return -1;
+                has_length = 1;
+                req->content_length = cl;
+                break;
             }
+            case HDR_TRANSFER_ENCODING:
+                has_encoding = 1;
+                break;
+            case HDR_IF_NONE_MATCH:
+                req->if_none_match.ptr = val;
+                req->if_none_match.len = next_line - val;
+                break;
+            case HDR_IF_MODIFIED_SINCE:
+                req->if_modified_since.ptr = val;
+                req->if_modified_since.len = next_line - val;
+                break;
+            case HDR_ACCEPT_ENCODING:
+                req->accept_gzip = accepts_gzip(val, next_line);
+                break;
+            default:
+                break;
         }
         current = next_line + 2;
     }
+
+    // 4. Só se aceita corpo com Content-Length. Com Transfer-Encoding (que não
+    // é suportado) o fim do corpo seria ambíguo: o resto da conexão podia
+    // ser lido como outro pedido (request smuggling)
+    if (has_encoding) {
+        if (!has_length) req->reject_status = 501;
+        return -1;
+    }
+    if (req->content_length > HTTP_MAX_BODY) {
+        req->reject_status = 413;
+        return -1;
+    }
+
+    // 5. Um corpo (ignorado) tem de chegar todo antes do próximo pedido
+    size_t total = (headers_end + 4 - buffer) + req->content_length;
+    if (total > len) {
+        *scanned = headers_end - buffer; // Voltar a encontrar os mesmos headers
+        return 0;
+    }
+    *scanned = 0;
+    return total;
+}
+
+
+// If-None-Match: "*" ou lista de ETags separadas por vírgulas. Em GET/HEAD
+// usa-se comparação fraca: W/"x" corresponde a "x".
+static int etag_list_matches(http_str_t list, const char* etag) {
+    size_t etag_len = strlen(etag);
+    const char* p = list.ptr;
+    const char* end = list.ptr + list.len;
+
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == ',')) p++;
+        const char* item = p;
+        while (p < end && *p != ',') p++;
+        const char* item_end = p;
+        while (item_end > item && item_end[-1] == ' ') item_end--;
+
+        if (item_end - item == 1 && *item == '*') return 1;
+        if (item_end - item > 2 && item[0] == 'W' && item[1] == '/') item += 2;
+        if ((size_t)(item_end - item) == etag_len && memcmp(item, etag, etag_len) == 0) return 1;
+    }
+    return 0;
+}
+
+int http_not_modified(const http_request_t* req, const char* etag, const char* last_modified) {
+    if (!http_str_eq(req->method, "GET") && !http_str_eq(req->method, "HEAD")) return 0;
+    if (req->if_none_match.len > 0) return etag[0] && etag_list_matches(req->if_none_match, etag);
+    if (req->if_modified_since.len > 0) return last_modified[0] && http_str_eq(req->if_modified_since, last_modified);
     return 0;
 }
 
+// If-Range: uma ETag (comparação forte) ou a data exata do Last-Modified
+static int if_range_matches(http_str_t v, const char* etag, const char* last_modified) {
+    if (v.len > 0 && (v.ptr[0] == '"' || v.ptr[0] == 'W')) {
+        return v.ptr[0] == '"' && etag[0] && http_str_eq(v, etag);
+    }
+    return last_modified[0] && http_str_eq(v, last_modified);
+}
+
+int http_parse_ranges(const http_request_t* req, long size, const char* etag,
+                      const char* last_modified, http_range_t* out, int max) {
+    if (req->range.len == 0 || !http_str_eq(req->method, "GET")) return -1;
+    if (req->if_range.len > 0 && !if_range_matches(req->if_range, etag, last_modified)) return -1;
+
+    const char* p = req->range.ptr;
+    const char* end = p + req->range.len;
+    if (end - p < 6 || strncasecmp(p, "bytes=", 6) != 0) return -1;
+    p += 6;
+
+    int count = 0, items = 0;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == ',')) p++;
+        if (p == end) break;
+        if (++items > max) return -1;
+
+        long first, last;
+        int satisfiable = 1;
+        if (*p == '-') { // Sufixo: os últimos N bytes
+            p++;
+            long n = parse_number(&p, end);
+            if (n < 0) return -1;
+            satisfiable = n > 0 && size > 0;
+            first = (n >= size) ? 0 : size - n;
+            last = size - 1;
+        } else {
+            first = parse_number(&p, end);
+            if (first < 0 || p >= end || *p != '-') return -1;
+            p++;
+            last = parse_number(&p, end); // -1: até ao fim
+            if (last != -1 && last < first) return -1;
+            satisfiable = first < size;
+            if (last == -1 || last >= size) last = size - 1;
+        }
+        if (satisfiable) {
+            out[count].start = first;
+            out[count].end = last;
+            count++;
+        }
+
+        while (p < end && *p == ' ') p++;
+        if (p < end && *p != ',') return -1;
+    }
+    return (items == 0) ? -1 : count;
+}
+
 
 // =========================
 // 7. HTTP Response Builder
 // =========================
 
-void send_http_response(int fd,
-                        int status,
-                        const char* status_msg,
-                        const char* content_type,
-                        const char* body,
-                        size_t body_len,
-                        int keep_alive)
+const char* get_mime_type(const char* filename) {
+    const char* dot = strrchr(filename, '.');
+    if (!dot) return "application/octet-stream";
+    if (strcmp(dot, ".html") == 0) return "text/html";
+    if (strcmp(dot, ".css") == 0) return "text/css";
+    if (strcmp(dot, ".js") == 0) return "application/javascript";
+    if (strcmp(dot, ".png") == 0) return "image/png";
+    if (strcmp(dot, ".jpg") == 0) return "image/jpeg";
+    if (strcmp(dot, ".gif") == 0) return "image/gif";
+    if (strcmp(dot, ".pdf") == 0) return "application/pdf";
+    if (strcmp(dot, ".json") == 0) return "application/json";
+    if (strcmp(dot, ".svg") == 0) return "image/svg+xml";
+    if (strcmp(dot, ".gz") == 0) return "application/gzip";
+    return "text/plain";
+}
+
+int http_compressible(const char* mime) {
+    return strncmp(mime, "text/", 5) == 0 ||
+           strcmp(mime, "application/javascript") == 0 ||
+           strcmp(mime, "application/json") == 0 ||
+           strcmp(mime, "image/svg+xml") == 0;
+}
+
+// Envia todos os buffers de 'iov' com sendmsg (um único syscall no caso
+// normal). Repete depois de escritas parciais avançando sobre os buffers
+// já enviados. MSG_NOSIGNAL: um cliente que fecha não mata o worker com SIGPIPE.
+int http_send_iov(int fd, struct iovec* iov, int iovcnt, int flags) {
+    while (iovcnt > 0 && iov->iov_len == 0) { iov++; iovcnt--; }
+
+    while (iovcnt > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t sent = sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        // Saltar os buffers completos e ajustar o parcial
+        while (iovcnt > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+int send_http_response(int fd,
+                       int status,
+                       const char* status_msg,
+                       const char* content_type,
+                       const char* body,
+                       size_t body_len,
+                       int keep_alive)
+{
+    return send_http_response_ex(fd, status, status_msg, content_type, NULL, body, body_len, keep_alive);
+}
+
+int send_http_response_ex(int fd, int status, const char* status_msg, const char* content_type,
+                          const char* extra_headers, const char* body, size_t body_len, int keep_alive)
 {
     char header[4096];
 
@@ -104,6 +516,7 @@ void send_http_response(int fd,
         "HTTP/1.1 %d %s\r\n"
         "Content-Type: %s\r\n"
         "Content-Length: %zu\r\n"
+        "%s"
         "Server: ConcurrentHTTP/1.0\r\n"
         "Connection: %s\r\n"
         "\r\n",
@@ -111,20 +524,96 @@ void send_http_response(int fd,
         status_msg,
         content_type,
         body_len,
+        extra_headers ? extra_headers : "",
         conn_header
     );
 
-    // Enviar header
-    if (send(fd, header, header_len, 0) < 0) return;
+    // Header e corpo juntos: um syscall e, em regra, um só segmento TCP
+    struct iovec iov[2] = {
+        {header, header_len},
+        {(void*)body, body ? body_len : 0}
+    };
+    return http_send_iov(fd, iov, 2, 0);
+}
+
+int send_http_not_modified(int fd, const char* etag, const char* last_modified, int vary, int keep_alive) {
+    char header[512];
+    int header_len = snprintf(
+        header,
+        sizeof(header),
+        "HTTP/1.1 304 Not Modified\r\n"
+        "ETag: %s\r\n"
+        "Last-Modified: %s\r\n"
+        "%s"
+        "Server: ConcurrentHTTP/1.0\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        etag, last_modified, vary ? "Vary: Accept-Encoding\r\n" : "",
+        keep_alive ? "keep-alive" : "close"
+    );
+    struct iovec iov = {header, header_len};
+    return http_send_iov(fd, &iov, 1, 0);
+}
 
-    // Enviar corpo
-    if (body && body_len > 0) {
-        send(fd, body, body_len, 0);
+// Corpos de ficheiro saem em janelas de STREAM_WINDOW: antes de cada uma
+// pede-se ao kernel a leitura antecipada da seguinte (WILLNEED), para o
+// disco trabalhar enquanto a janela atual vai para a rede.
+#define STREAM_WINDOW (512 * 1024)
+// Buffer por thread para quando o sendfile não é suportado (ex: alguns FS)
+#define STREAM_BUFFER (64 * 1024)
+
+// Cópia por user space com memória fixa: pread + send em blocos de STREAM_BUFFER
+static int copy_file_body(int fd, int file_fd, off_t offset, size_t len) {
+    static __thread char buf[STREAM_BUFFER];
+    while (len > 0) {
+        size_t want = (len < sizeof(buf)) ? len : sizeof(buf);
+        ssize_t got = pread(file_fd, buf, want, offset);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return -1; // Erro ou ficheiro encolheu entretanto
+        struct iovec iov = {buf, got};
+        if (http_send_iov(fd, &iov, 1, 0) < 0) return -1;
+        offset += got;
+        len -= got;
     }
+    return 0;
 }
 
-void send_http_partial_response(int fd, const char* content_type, const char* body, 
-                                size_t chunk_size, long start, long end, long total_size, int keep_alive)
+// Envia 'len' bytes de 'file_fd' a partir de 'offset' sem passar por user space.
+// Repete em caso de escrita parcial (socket buffer cheio). A memória usada
+// não depende do tamanho do ficheiro nem do número de downloads em curso.
+static int send_file_body(int fd, int file_fd, off_t offset, size_t len) {
+    if (len > STREAM_WINDOW) {
+        posix_fadvise(file_fd, offset, len, POSIX_FADV_SEQUENTIAL); // Readahead maior
+    }
+
+    while (len > 0) {
+        size_t window = (len < STREAM_WINDOW) ? len : STREAM_WINDOW;
+        if (len > window) {
+            size_t ahead = (len - window < STREAM_WINDOW) ? len - window : STREAM_WINDOW;
+            posix_fadvise(file_fd, offset + window, ahead, POSIX_FADV_WILLNEED);
+        }
+
+        // 1. Janela atual por sendfile (zero-copy)
+        while (window > 0) {
+            ssize_t sent = sendfile(fd, file_fd, &offset, window);
+            if (sent < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EINVAL || errno == ENOSYS) {
+                    // 2. Sem sendfile para este ficheiro: resto por cópia
+                    return copy_file_body(fd, file_fd, offset, len);
+                }
+                return -1;
+            }
+            if (sent == 0) return -1; // Ficheiro encolheu entretanto
+            window -= sent;
+            len -= sent;
+        }
+    }
+    return 0;
+}
+
+int send_http_file_response(int fd, int status, const char* status_msg, const char* content_type,
+                            int file_fd, size_t body_len, int keep_alive)
 {
     char header[4096];
     const char* conn_header = keep_alive ? "keep-alive" : "close";
@@ -132,21 +621,139 @@ void send_http_partial_response(int fd, const char* content_type, const char* bo
     int header_len = snprintf(
         header,
         sizeof(header),
-        "HTTP/1.1 206 Partial Content\r\n"
+        "HTTP/1.1 %d %s\r\n"
         "Content-Type: %s\r\n"
         "Content-Length: %zu\r\n"
-        "Content-Range: bytes %ld-%ld/%ld\r\n"
         "Server: ConcurrentHTTP/1.0\r\n"
         "Connection: %s\r\n"
         "\r\n",
+        status,
+        status_msg,
         content_type,
-        chunk_size,
-        start, end, total_size,
+        body_len,
         conn_header
     );
 
-    if (send(fd, header, header_len, 0) < 0) return;
-    if (body && chunk_size > 0) {
-        send(fd, body, chunk_size, 0);
+    // MSG_MORE: o header segue no mesmo segmento TCP que o início do corpo
+    struct iovec iov = {header, header_len};
+    if (http_send_iov(fd, &iov, 1, body_len > 0 ? MSG_MORE : 0) < 0) return -1;
+    return (body_len > 0) ? send_file_body(fd, file_fd, 0, body_len) : 0;
+}
+
+// Separador das partes de multipart/byteranges (não pode aparecer no corpo:
+// 20 dígitos hexadecimais que mudam a cada resposta)
+static void make_boundary(char* out, size_t size) {
+    static atomic_ulong counter;
+    unsigned long n = atomic_fetch_add(&counter, 1) + 1;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    unsigned long x = (n * 0x9E3779B97F4A7C15UL) ^ ((unsigned long)ts.tv_nsec << 20) ^ (unsigned long)getpid();
+    snprintf(out, size, "%020lx", x);
+}
+
+int send_http_ranges(int fd, const char* content_type, const char* extra_headers, const char* body,
+                     int file_fd, const http_range_t* ranges, int count, long total_size, int keep_alive)
+{
+    const char* conn_header = keep_alive ? "keep-alive" : "close";
+    char header[4096];
+    int header_len;
+
+    // 1. Um só intervalo: 206 simples com Content-Range
+    if (count == 1) {
+        size_t chunk = ranges[0].end - ranges[0].start + 1;
+        header_len = snprintf(header, sizeof(header),
+            "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Type: %s\r\n"
+            "Content-Length: %zu\r\n"
+            "Content-Range: bytes %ld-%ld/%ld\r\n"
+            "%s"
+            "Server: ConcurrentHTTP/1.0\r\n"
+            "Connection: %s\r\n"
+            "\r\n",
+            content_type, chunk, ranges[0].start, ranges[0].end, total_size,
+            extra_headers ? extra_headers : "", conn_header);
+
+        if (body) {
+            struct iovec iov[2] = {{header, header_len}, {(void*)(body + ranges[0].start), chunk}};
+            return http_send_iov(fd, iov, 2, 0);
+        }
+        struct iovec iov = {header, header_len};
+        if (http_send_iov(fd, &iov, 1, MSG_MORE) < 0) return -1;
+        return send_file_body(fd, file_fd, ranges[0].start, chunk);
+    }
+
+    // 2. Vários: cada parte tem o seu mini-header; o Content-Length soma tudo
+    char boundary[24];
+    make_boundary(boundary, sizeof(boundary));
+
+    char parts[HTTP_MAX_RANGES][192];
+    int part_len[HTTP_MAX_RANGES];
+    size_t content_length = 0;
+    for (int i = 0; i < count; i++) {
+        part_len[i] = snprintf(parts[i], sizeof(parts[i]),
+            "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %ld-%ld/%ld\r\n\r\n",
+            boundary, content_type, ranges[i].start, ranges[i].end, total_size);
+        content_length += part_len[i] + (ranges[i].end - ranges[i].start + 1);
+    }
+    char trailer[32];
+    int trailer_len = snprintf(trailer, sizeof(trailer), "\r\n--%s--\r\n", boundary);
+    content_length += trailer_len;
+
+    header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 206 Partial Content\r\n"
+        "Content-Type: multipart/byteranges; boundary=%s\r\n"
+        "Content-Length: %zu\r\n"
+        "%s"
+        "Server: ConcurrentHTTP/1.0\r\n"
+        "Connection: %s\r\n"
+        "\r\n",
+        boundary, content_length, extra_headers ? extra_headers : "", conn_header);
+
+    if (body) {
+        // Tudo em memória: header, partes e fatias do corpo num único sendmsg
+        struct iovec iov[2 * HTTP_MAX_RANGES + 2];
+        int n = 0;
+        iov[n++] = (struct iovec){header, header_len};
+        for (int i = 0; i < count; i++) {
+            iov[n++] = (struct iovec){parts[i], part_len[i]};
+            iov[n++] = (struct iovec){(void*)(body + ranges[i].start), ranges[i].end - ranges[i].start + 1};
+        }
+        iov[n++] = (struct iovec){trailer, trailer_len};
+        return http_send_iov(fd, iov, n, 0);
     }
-}
\ No newline at end of file
+
+    struct iovec iov[2] = {{header, header_len}, {parts[0], part_len[0]}};
+    if (http_send_iov(fd, iov, 2, MSG_MORE) < 0) return -1;
+    for (int i = 0; i < count; i++) {
+        if (i > 0) {
+            struct iovec part = {parts[i], part_len[i]};
+            if (http_send_iov(fd, &part, 1, MSG_MORE) < 0) return -1;
+        }
+        if (send_file_body(fd, file_fd, ranges[i].start, ranges[i].end - ranges[i].start + 1) < 0) return -1;
+    }
+    struct iovec end = {trailer, trailer_len};
+    return http_send_iov(fd, &end, 1, 0);
+}
+
+int send_http_range_not_satisfiable(int fd, long total_size, int keep_alive) {
+    static const char body[] = "416 Range Not Satisfiable";
+    char extra[64];
+    snprintf(extra, sizeof(extra), "Content-Range: bytes */%ld\r\n", total_size);
+    return send_http_response_ex(fd, 416, "Range Not Satisfiable", "text/plain", extra,
+                                 body, sizeof(body) - 1, keep_alive);
+}
+
+int send_http_prebuilt_file_response(int fd, const char* header_prefix, size_t prefix_len,
+                                     int file_fd, size_t body_len, int keep_alive)
+{
+    static const char keep[] = "Connection: keep-alive\r\n\r\n";
+    static const char close_[] = "Connection: close\r\n\r\n";
+    int has_body = file_fd >= 0 && body_len > 0;
+
+    struct iovec iov[2] = {
+        {(void*)header_prefix, prefix_len},
+        {(void*)(keep_alive ? keep : close_), keep_alive ? sizeof(keep) - 1 : sizeof(close_) - 1}
+    };
+    if (http_send_iov(fd, iov, 2, has_body ? MSG_MORE : 0) < 0) return -1;
+    return has_body ? send_file_body(fd, file_fd, 0, body_len) : 0;
+}
@@ -3,43 +3,130 @@
 #define HTTP_H
 
 #include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 // =========================
 // HTTP Request Structure
 // =========================
 
+// Vista (ponteiro + tamanho) para dentro do buffer da conexão: não é
+// terminada em '\0' e só é válida enquanto o buffer não for alterado
 typedef struct {
-    char method[16];
-    char path[512];
-    char version[16];
-    char host[128];
-    long range_start;
-    long range_end;
+    const char* ptr;
+    size_t len;
+} http_str_t;
+
+typedef struct {
+    http_str_t method;
+    http_str_t path;
+    http_str_t version;
+    http_str_t host;       // Sem a porta (localhost:8080 -> localhost)
+    http_str_t range;      // Valor do header Range (len == 0: ausente)
+    http_str_t if_range;   // ETag forte ou data (len == 0: ausente)
     int connection_close;
+    size_t content_length; // Corpo a descartar antes do pedido seguinte
+    http_str_t if_none_match;     // Pedidos condicionais (len == 0: ausente)
+    http_str_t if_modified_since;
+    int accept_gzip;              // Accept-Encoding inclui gzip (com q > 0)
+    int reject_status;            // Parser devolveu -1: 400, 413 ou 501
 } http_request_t;
 
+#define HTTP_MAX_METHOD 15
+#define HTTP_MAX_PATH 511
+#define HTTP_MAX_BODY 4096 // Content-Length acima disto: 413 (o pedido tem de caber no buffer)
+#define HTTP_MAX_RANGES 8 // Mais intervalos do que isto: o Range é ignorado (200)
+
+// Intervalo de bytes já resolvido contra o tamanho do ficheiro (inclusivo)
+typedef struct {
+    long start;
+    long end;
+} http_range_t;
+
+// Compara uma vista com uma string C
+int http_str_eq(http_str_t s, const char* lit);
+int http_str_case_eq(http_str_t s, const char* lit);
+
 
 // =========================
 // HTTP Request Parser
 // =========================
 
-int parse_http_request(const char* buffer, http_request_t* req);
+// Parser incremental: 'len' bytes a partir de 'buffer' (podem conter vários
+// pedidos em pipeline ou só parte de um). '*scanned' guarda até onde já se
+// procurou o fim dos headers, para a próxima chamada não voltar ao início.
+// Devolve o tamanho do pedido completo (headers + corpo), 0 se faltam
+// dados ou -1 se o pedido é rejeitado (o status a enviar fica em
+// req->reject_status).
+long parse_http_request(const char* buffer, size_t len, size_t* scanned, http_request_t* req);
+
+// 1 se o cliente já tem esta versão (If-None-Match tem prioridade sobre
+// If-Modified-Since, que se compara com o Last-Modified enviado, como o nginx)
+int http_not_modified(const http_request_t* req, const char* etag, const char* last_modified);
+
+// Intervalos pedidos em 'req->range' para um corpo de 'size' bytes.
+// Suporta "a-b", "a-" e sufixos "-n", separados por vírgulas.
+// Devolve o número de intervalos, 0 se nenhum é satisfazível (416) ou -1
+// se o Range não se aplica: ausente, inválido, não é GET, demasiados
+// intervalos ou If-Range não corresponde à versão atual (resposta 200).
+int http_parse_ranges(const http_request_t* req, long size, const char* etag,
+                      const char* last_modified, http_range_t* out, int max);
+
+// Scanner de delimitadores usado pelo parser ("avx2", "sse2" ou "scalar").
+// É escolhido no arranque conforme o CPU; select serve para benchmarks e
+// devolve -1 se o CPU não suportar a implementação pedida.
+const char* http_scanner_name(void);
+int http_scanner_select(const char* name);
 
 
 // =========================
 // HTTP Response Builder
 // =========================
 
-// Agora aceita o flag 'keep_alive'
-void send_http_response(int fd,
-                        int status,
-                        const char* status_msg,
-                        const char* content_type,
-                        const char* body,
-                        size_t body_len,
-                        int keep_alive);
-
-void send_http_partial_response(int fd, const char* content_type, const char* body, 
-                                size_t chunk_size, long start, long end, long total_size, int keep_alive);
+const char* get_mime_type(const char* filename);
+
+// 1 se vale a pena comprimir respostas deste tipo (texto, JS, JSON, SVG)
+int http_compressible(const char* mime);
+
+// Todas devolvem 0 se a resposta foi enviada por completo ou -1 se o
+// cliente fechou / houve erro (as escritas parciais são repetidas).
+
+// Envia vários buffers com um só sendmsg (repete em escritas parciais)
+int http_send_iov(int fd, struct iovec* iov, int iovcnt, int flags);
+
+// Header e corpo saem juntos num único writev
+int send_http_response(int fd,
+                       int status,
+                       const char* status_msg,
+                       const char* content_type,
+                       const char* body,
+                       size_t body_len,
+                       int keep_alive);
+
+// Como send_http_response, com linhas de header extra já formatadas
+// ("Nome: valor\r\n..."; NULL = nenhuma)
+int send_http_response_ex(int fd, int status, const char* status_msg, const char* content_type,
+                          const char* extra_headers, const char* body, size_t body_len, int keep_alive);
+
+// 304 Not Modified (sem corpo) com os validadores atuais.
+// 'vary' = 1 repete o "Vary: Accept-Encoding" da resposta 200.
+int send_http_not_modified(int fd, const char* etag, const char* last_modified, int vary, int keep_alive);
+
+// 206 com um ou vários intervalos (multipart/byteranges). O corpo vem de
+// 'body' (cache, num só sendmsg) ou, se body == NULL, de 'file_fd' via sendfile.
+int send_http_ranges(int fd, const char* content_type, const char* extra_headers, const char* body,
+                     int file_fd, const http_range_t* ranges, int count, long total_size, int keep_alive);
+
+// 416 Range Not Satisfiable com "Content-Range: bytes */total"
+int send_http_range_not_satisfiable(int fd, long total_size, int keep_alive);
+
+// Versões zero-copy: o corpo vem diretamente de 'file_fd' via sendfile()
+int send_http_file_response(int fd, int status, const char* status_msg, const char* content_type,
+                            int file_fd, size_t body_len, int keep_alive);
+
+// Header já formatado (sem Connection nem a linha vazia) + corpo via sendfile.
+// Com file_fd < 0 só envia o header (HEAD).
+int send_http_prebuilt_file_response(int fd, const char* header_prefix, size_t prefix_len,
+                                     int file_fd, size_t body_len, int keep_alive);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,100 @@
+// src/journal.c
+#define _POSIX_C_SOURCE 200809L
+#include "journal.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+// Vista do processo atual (cada worker mapeia o ficheiro uma vez)
+static journal_header_t* journal = NULL;
+static journal_record_t* records = NULL;
+static size_t journal_size = 0;
+static int journal_worker = 0;
+
+int journal_create(size_t entries) {
+    shm_unlink(JOURNAL_NAME); // Journal da execução anterior
+    if (entries == 0) return 0;
+
+    size_t capacity = 1;
+    while (capacity < entries) capacity <<= 1;
+    size_t size = sizeof(journal_header_t) + capacity * sizeof(journal_record_t);
+
+    int fd = shm_open(JOURNAL_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd == -1) return -1;
+    if (ftruncate(fd, size) == -1) { // Registos a zeros (seq = 0: vazio)
+        close(fd);
+        return -1;
+    }
+
+    journal_header_t* h = mmap(NULL, sizeof(journal_header_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) return -1;
+
+    h->capacity = capacity;
+    h->head = 0;
+    h->record_size = sizeof(journal_record_t);
+    h->version = JOURNAL_VERSION;
+    __atomic_store_n(&h->magic, JOURNAL_MAGIC, __ATOMIC_RELEASE);
+    munmap(h, sizeof(journal_header_t));
+    return 0;
+}
+
+void journal_attach(int worker_id) {
+    int fd = shm_open(JOURNAL_NAME, O_RDWR, 0644);
+    if (fd == -1) return; // Journal desligado
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(journal_header_t)) {
+        close(fd);
+        return;
+    }
+
+    void* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return;
+
+    journal_header_t* h = base;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != JOURNAL_MAGIC ||
+        h->record_size != sizeof(journal_record_t)) {
+        munmap(base, st.st_size);
+        return;
+    }
+
+    journal = h;
+    records = (journal_record_t*)(h + 1);
+    journal_size = st.st_size;
+    journal_worker = worker_id;
+}
+
+void journal_record(int status, size_t bytes, long latency_us, int lat_class, const char* path) {
+    if (!journal) return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    // 1. Reservar a posição (único ponto de contenção: um fetch_add)
+    uint64_t pos = __atomic_fetch_add(&journal->head, 1, __ATOMIC_RELAXED);
+    journal_record_t* r = &records[pos & (journal->capacity - 1)];
+
+    // 2. Invalidar, preencher e publicar (o leitor descarta registos com seq errado)
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    r->timestamp_us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    r->path_hash = journal_hash_path(path);
+    r->bytes = bytes;
+    r->latency_us = (latency_us < 0) ? 0 : (latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t)latency_us);
+    r->status = status;
+    r->worker = journal_worker;
+    r->lat_class = lat_class;
+    __atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+void journal_detach(void) {
+    if (!journal) return;
+    munmap(journal, journal_size);
+    journal = NULL;
+    records = NULL;
+}
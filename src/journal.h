@@ -0,0 +1,56 @@
+// src/journal.h
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JOURNAL_NAME "/webserver_journal" // Fica em /dev/shm ao lado de /webserver_shm
+#define JOURNAL_PATH "/dev/shm/webserver_journal"
+#define JOURNAL_MAGIC 0x4A535752u // "RWSJ"
+#define JOURNAL_VERSION 1
+
+// Registo binário de tamanho fixo (um por pedido).
+// 'seq' é escrito por último (release): 0 = a ser escrito, pos + 1 = completo.
+typedef struct {
+    uint64_t seq;
+    uint64_t timestamp_us;  // CLOCK_REALTIME
+    uint64_t path_hash;     // FNV-1a do path pedido
+    uint64_t bytes;
+    uint32_t latency_us;
+    uint16_t status;
+    uint8_t worker;
+    uint8_t lat_class;      // latency_class_t (LAT_CACHE_HIT = cache hit)
+} journal_record_t;
+
+// O ficheiro é [header][records]; 'capacity' é uma potência de 2
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t head;          // Próxima posição (fetch_add pelos writers)
+    uint64_t record_size;
+} journal_header_t;
+
+// Hash do path (o decoder usa a mesma função para filtrar por path)
+static inline uint64_t journal_hash_path(const char* path) {
+    uint64_t h = 14695981039346656037ULL;
+    while (*path) {
+        h ^= (unsigned char)*path++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Master: cria (ou recria) o journal com 'entries' registos (0 = desligado)
+int journal_create(size_t entries);
+
+// Worker: mapeia o journal criado pelo Master (sem efeito se não existir)
+void journal_attach(int worker_id);
+
+// Sem locks e sem formatação: reserva uma posição e copia os campos
+void journal_record(int status, size_t bytes, long latency_us, int lat_class, const char* path);
+
+void journal_detach(void);
+
+#endif
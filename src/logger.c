@@ -1,47 +1,224 @@
-// src/logger.c - COM ROTAÇÃO DE LOGS
+// src/logger.c - LOG ASSÍNCRONO COM ROTAÇÃO
+#define _POSIX_C_SOURCE 200809L
 #include "logger.h"
 #include <stdio.h>
 #include <time.h>
 #include <string.h>
-#include <stdlib.h> 
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 
-#define MAX_LOG_SIZE (10 * 1024 * 1024) // 10 MB
+// Ring bounded MPSC (algoritmo de Vyukov): cada célula tem um número de
+// sequência que diz se está livre para o produtor 'pos' ou pronta para o leitor.
+typedef struct {
+    atomic_size_t seq;
+    int len;
+    char data[LOG_LINE_MAX];
+} log_cell_t;
 
-void log_request(sem_t* log_sem, const char* client_ip,
+static log_cell_t* ring = NULL;
+static atomic_size_t enqueue_pos;
+static size_t dequeue_pos;      // Só a thread de escrita mexe
+static atomic_long dropped;
+
+static shared_data_t* log_shm = NULL;
+static char log_path[256];
+static int log_fd = -1;
+static unsigned log_gen;        // Geração do ficheiro que temos aberto
+
+static pthread_t writer;
+static atomic_int writer_running;
+
+// Timestamp formatado só uma vez por segundo (por thread)
+static __thread time_t ts_sec = -1;
+static __thread char ts_buf[64];
+
+static int open_log(void) {
+    return open(log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+void logger_init_shared(shared_data_t* shm, const char* path) {
+    struct stat st;
+    long size = (path && path[0] && stat(path, &st) == 0) ? st.st_size : 0;
+    atomic_store(&shm->log_size, size);
+    atomic_store(&shm->log_generation, 0);
+}
+
+// Rotação partilhada: o worker cujo write cruza o limite renomeia o ficheiro
+// e incrementa a geração; os outros reabrem quando a veem mudar.
+static void account_and_rotate(size_t written) {
+    long prev = atomic_fetch_add(&log_shm->log_size, (long)written);
+    if (prev < MAX_LOG_SIZE && prev + (long)written >= MAX_LOG_SIZE) {
+        char rotated[300];
+        snprintf(rotated, sizeof(rotated), "%s.1", log_path); // Sobrescreve o antigo .1
+        rename(log_path, rotated);
+        atomic_store(&log_shm->log_size, 0);
+        atomic_fetch_add(&log_shm->log_generation, 1);
+    }
+
+    unsigned gen = atomic_load(&log_shm->log_generation);
+    if (gen != log_gen) {
+        int fd = open_log();
+        if (fd >= 0) {
+            close(log_fd);
+            log_fd = fd;
+            log_gen = gen;
+        }
+    }
+}
+
+// writev completo (continua depois de escritas parciais)
+static void write_all(struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(log_fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return; // Disco cheio, etc.: as linhas perdem-se
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+// Recolhe até LOG_BATCH linhas prontas e escreve-as com um único writev.
+// Devolve o número de linhas escritas.
+static int flush_batch(void) {
+    struct iovec iov[LOG_BATCH];
+    size_t total = 0;
+    int count = 0;
+
+    // 1. Recolher células prontas (seq == pos + 1)
+    while (count < LOG_BATCH) {
+        log_cell_t* cell = &ring[(dequeue_pos + count) & (LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        if (seq != dequeue_pos + count + 1) break;
+        iov[count].iov_base = cell->data;
+        iov[count].iov_len = cell->len;
+        total += cell->len;
+        count++;
+    }
+    if (count == 0) return 0;
+
+    // 2. Escrever o lote e contabilizar para a rotação
+    if (log_fd >= 0) {
+        write_all(iov, count);
+        account_and_rotate(total);
+    }
+
+    // 3. Devolver as células aos produtores (próxima volta do ring)
+    for (int i = 0; i < count; i++) {
+        log_cell_t* cell = &ring[(dequeue_pos + i) & (LOG_RING_SIZE - 1)];
+        atomic_store_explicit(&cell->seq, dequeue_pos + i + LOG_RING_SIZE, memory_order_release);
+    }
+    dequeue_pos += count;
+    return count;
+}
+
+static void* writer_thread(void* arg) {
+    (void)arg;
+    struct timespec idle = {0, 10 * 1000000L}; // 10 ms
+
+    while (1) {
+        int running = atomic_load(&writer_running);
+        if (flush_batch() > 0) continue;
+        if (!running) break; // Ring vazio depois do pedido de paragem
+        nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+int logger_init(shared_data_t* shm, const char* path) {
+    log_shm = shm;
+    snprintf(log_path, sizeof(log_path), "%s", (path && path[0]) ? path : "access.log");
+
+    ring = malloc(sizeof(log_cell_t) * LOG_RING_SIZE);
+    if (!ring) return -1;
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) atomic_init(&ring[i].seq, i);
+    atomic_init(&enqueue_pos, 0);
+    atomic_init(&dropped, 0);
+    dequeue_pos = 0;
+
+    log_gen = atomic_load(&shm->log_generation);
+    log_fd = open_log();
+    if (log_fd < 0) perror("Logger: falha ao abrir o ficheiro de log");
+
+    atomic_store(&writer_running, 1);
+    if (pthread_create(&writer, NULL, writer_thread, NULL) != 0) {
+        if (log_fd >= 0) close(log_fd);
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void log_request(const char* client_ip,
                  const char* method, const char* path,
                  int status, size_t bytes) {
-    
-    time_t now = time(NULL);
-    struct tm tm_info;
-    localtime_r(&now, &tm_info);
-    char timestamp[64];
-    strftime(timestamp, sizeof(timestamp), "%d/%b/%Y:%H:%M:%S %z", &tm_info);
-
-    // 1. ADQUIRIR O SEMÁFORO
-    sem_wait(log_sem);
-
-    // 2. VERIFICAR ROTAÇÃO
-    FILE* check_file = fopen("access.log", "r");
-    if (check_file) {
-        fseek(check_file, 0, SEEK_END);
-        long filesize = ftell(check_file);
-        fclose(check_file);
-
-        if (filesize >= MAX_LOG_SIZE) {
-            // Rotação simples: access.log -> access.log.1 (sobrescreve o antigo .1)
-            rename("access.log", "access.log.1");
+    if (!ring) return;
+
+    // 1. Reservar uma célula (CAS na posição de escrita)
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    log_cell_t* cell;
+    while (1) {
+        cell = &ring[pos & (LOG_RING_SIZE - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed); // Ring cheio
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
         }
     }
 
-    // 3. ESCREVER LOG
-    FILE* log_file = fopen("access.log", "a");
-    if (log_file) {
-        fprintf(log_file, "%s - [%s] \"%s %s HTTP/1.1\" %d %zu\n",
-                client_ip, timestamp, method, path, status, bytes);
-        fflush(log_file); 
-        fclose(log_file);
+    // 2. Formatar diretamente na célula
+    time_t now = time(NULL);
+    if (now != ts_sec) {
+        struct tm tm_info;
+        localtime_r(&now, &tm_info);
+        strftime(ts_buf, sizeof(ts_buf), "%d/%b/%Y:%H:%M:%S %z", &tm_info);
+        ts_sec = now;
+    }
+    int len = snprintf(cell->data, LOG_LINE_MAX, "%s - [%s] \"%s %s HTTP/1.1\" %d %zu\n",
+                       client_ip, ts_buf, method, path, status, bytes);
+    if (len >= LOG_LINE_MAX) {
+        len = LOG_LINE_MAX - 1;
+        cell->data[len - 1] = '\n'; // Path demasiado longo: truncar mas manter a linha
     }
-    
-    // 4. LIBERTAR O SEMÁFORO
-    sem_post(log_sem);
-}
\ No newline at end of file
+    cell->len = len;
+
+    // 3. Publicar para a thread de escrita
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+}
+
+void logger_shutdown(void) {
+    if (!ring) return;
+    atomic_store(&writer_running, 0);
+    pthread_join(writer, NULL);
+
+    long lost = atomic_load(&dropped);
+    if (lost > 0) fprintf(stderr, "Logger: %ld linhas descartadas (ring cheio)\n", lost);
+
+    if (log_fd >= 0) close(log_fd);
+    log_fd = -1;
+    free(ring);
+    ring = NULL;
+}
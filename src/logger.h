@@ -1,11 +1,28 @@
-// logger.h
+// src/logger.h
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <semaphore.h>
+#include <stddef.h>
+#include "shared_mem.h"
 
-void log_request(sem_t* log_sem, const char* client_ip, 
-                 const char* method, const char* path, 
+#define LOG_RING_SIZE 2048  // Linhas pendentes por worker (potência de 2)
+#define LOG_LINE_MAX 512
+#define LOG_BATCH 64        // Linhas por writev
+#define MAX_LOG_SIZE (10 * 1024 * 1024) // 10 MB
+
+// Master: regista o tamanho atual do ficheiro antes de criar os workers
+void logger_init_shared(shared_data_t* shm, const char* path);
+
+// Worker: abre o ficheiro (LOG_FILE) e arranca a thread de escrita
+int logger_init(shared_data_t* shm, const char* path);
+
+// Formata a linha e coloca-a no ring do worker (sem locks, nunca bloqueia).
+// Se o ring estiver cheio a linha é descartada e contada.
+void log_request(const char* client_ip,
+                 const char* method, const char* path,
                  int status, size_t bytes);
 
-#endif
\ No newline at end of file
+// Escreve as linhas pendentes e termina a thread de escrita
+void logger_shutdown(void);
+
+#endif
@@ -8,8 +8,11 @@
 int main(int argc, char *argv[]) {
     server_config_t config;
     memset(&config, 0, sizeof(config));
-    if (load_config("server.conf", &config) != 0) {
-        printf("Erro ao carregar server.conf\n");
+
+    // Permite indicar outro ficheiro de configuração: ./server [config]
+    const char* config_file = (argc > 1) ? argv[1] : "server.conf";
+    if (load_config(config_file, &config) != 0) {
+        printf("Erro ao carregar %s\n", config_file);
         return 1;
     }
 
@@ -1,10 +1,11 @@
 // src/master.c
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // SO_REUSEPORT
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <signal.h>
@@ -18,6 +19,11 @@
 #include "semaphores.h"
 #include "worker.h"
 #include "stats.h"
+#include "shm_cache.h"
+#include "logger.h"
+#include "journal.h"
+#include "cgi.h"
+#include "rebalance.h"
 
 volatile sig_atomic_t keep_running = 1;
 
@@ -26,7 +32,7 @@ void signal_handler(int signum) {
     keep_running = 0;
 }
 
-int create_server_socket(int port) {
+int create_server_socket(int port, int reuse_port) {
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) return -1;
 
@@ -37,6 +43,13 @@ int create_server_socket(int port) {
         return -1;
     }
 
+    // Vários sockets na mesma porta: o kernel distribui as conexões entre eles
+    if (reuse_port && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("Setsockopt SO_REUSEPORT falhou");
+        close(sockfd);
+        return -1;
+    }
+
     struct sockaddr_in addr;
     addr.sin_family      = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
@@ -70,14 +83,22 @@ void master_run(server_config_t *config) {
     // 1. Limpeza Preventiva de recursos antigos
     shm_unlink("/webserver_shm"); 
     sem_unlink("/ws_empty"); sem_unlink("/ws_filled");
-    sem_unlink("/ws_queue_mutex"); sem_unlink("/ws_stats_mutex"); sem_unlink("/ws_log_mutex");
+    sem_unlink("/ws_queue_mutex"); sem_unlink("/ws_stats_mutex");
+    shm_unlink(SHM_CACHE_NAME);
 
     // 2. Setup da Memória Partilhada (Stats)
     shared_data_t* shm = create_shared_memory();
     if (!shm) { perror("Master: Falha SHM"); exit(1); }
     
     memset(shm, 0, sizeof(shared_data_t)); 
-    shm->stats.start_time = time(NULL);
+    shm->start_time = time(NULL);
+    logger_init_shared(shm, config->log_file);
+
+    // 2.1 Journal binário: fica em /dev/shm depois de o servidor parar
+    // (para ser lido com o journal_tool); só é recriado no arranque seguinte
+    if (config->journal_entries > 0 && journal_create(config->journal_entries) != 0) {
+        perror("Master: Falha Journal");
+    }
 
     // 3. Setup dos Semáforos
     semaphores_t sems;
@@ -86,21 +107,64 @@ void master_run(server_config_t *config) {
         exit(1);
     }
 
+    // A SHM só tem slots de estatísticas para MAX_WORKERS workers
+    if (config->num_workers > MAX_WORKERS) {
+        printf("Master: NUM_WORKERS limitado a %d\n", MAX_WORKERS);
+        config->num_workers = MAX_WORKERS;
+    }
+
+    // 3.1 Cache partilhada (opcional): o orçamento é o das N caches privadas
+    // que substitui, mas cada ficheiro fica guardado uma única vez
+    shm_cache_t* shared_cache = NULL;
+    if (config->shared_cache) {
+        shared_cache = shm_cache_create((size_t)config->cache_size_mb * config->num_workers);
+        if (!shared_cache) {
+            perror("Master: Falha Cache SHM");
+            exit(1);
+        }
+    }
+
+    // 3.2 Pool CGI: os interpretadores arrancam antes dos sockets TCP
+    // existirem; os workers herdam só o endereço do socket Unix
+    if (config->cgi_pool_size > 0 && cgi_pool_start(config) != 0) {
+        perror("Master: Falha Pool CGI (fallback para fork por pedido)");
+    }
+
     // 4. Criação do Socket (O Master cria, os Workers herdam)
-    int server_socket = create_server_socket(config->port);
-    if (server_socket < 0) exit(1);
+    // Modo REUSE_PORT: um socket por worker, cada um aceita sem lock
+    int num_sockets = config->reuse_port ? config->num_workers : 1;
+    int server_sockets[num_sockets];
+    for (int i = 0; i < num_sockets; i++) {
+        server_sockets[i] = create_server_socket(config->port, config->reuse_port);
+        if (server_sockets[i] < 0) exit(1);
+    }
+
+    // 4.1 Reencaminhamento de conexões: um socketpair por worker, herdado por todos
+    if (config->rebalance && config->num_workers > 1 && rebalance_init(shm, config->num_workers) != 0) {
+        perror("Master: Falha Rebalance (cada worker fica com as suas conexões)");
+    }
 
     // 5. Fork dos Workers
     pid_t pids[config->num_workers];
     for (int i = 0; i < config->num_workers; i++) {
         pids[i] = fork();
         if (pids[i] == 0) {
-            // Processo Filho (Worker)
-            worker_main(i, server_socket, config);
+            // Processo Filho (Worker): fica apenas com o seu socket
+            int own = config->reuse_port ? i : 0;
+            for (int j = 0; j < num_sockets; j++) {
+                if (j != own) close(server_sockets[j]);
+            }
+            worker_main(i, server_sockets[own], config);
             exit(0);
         }
     }
 
+    // Em REUSE_PORT o Master não guarda os sockets: se um worker morrer,
+    // o seu socket fecha e o kernel deixa de lhe enviar conexões
+    if (config->reuse_port) {
+        for (int i = 0; i < num_sockets; i++) close(server_sockets[i]);
+    }
+
     printf("Master: Workers iniciados. Servidor Online.\n");
 
     // 6. Monitorização do Loop Principal do Master
@@ -108,10 +172,23 @@ void master_run(server_config_t *config) {
     
     while (keep_running) {
         sleep(1); 
+        cgi_pool_reap(); // Health check: relançar interpretadores mortos
+
+        // Worker que morreu deixa de receber conexões reencaminhadas
+        for (int i = 0; i < config->num_workers; i++) {
+            if (pids[i] > 0 && waitpid(pids[i], NULL, WNOHANG) == pids[i]) {
+                rebalance_worker_down(i);
+                // Referências que o worker tinha na cache partilhada já não vão ser largadas
+                if (shared_cache) shm_cache_release_worker(shared_cache, i);
+                pids[i] = 0;
+            }
+            // Conexões entregues a um worker que já não existe: fechar
+            if (pids[i] == 0) rebalance_drain(i);
+        }
         
         countdown++;
         if (countdown >= config->timeout_seconds) {
-            display_stats(shm, &sems);
+            display_stats(shm);
             countdown = 0;
         }
     }
@@ -121,10 +198,15 @@ void master_run(server_config_t *config) {
     for (int i = 0; i < config->num_workers; i++) {
         if (pids[i] > 0) kill(pids[i], SIGTERM);
     }
-    for (int i = 0; i < config->num_workers; i++) wait(NULL);
+    for (int i = 0; i < config->num_workers; i++) {
+        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
+    }
+    cgi_pool_stop();
+    rebalance_destroy();
 
-    close(server_socket);
+    if (!config->reuse_port) close(server_sockets[0]);
     destroy_semaphores(&sems);
     destroy_shared_memory(shm);
+    if (shared_cache) shm_cache_destroy(shared_cache);
     printf("Master: Limpeza concluída.\n");
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+// src/rebalance.c
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC
+#include "rebalance.h"
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+// socks[w][0]: receção do worker w | socks[w][1]: envio para o worker w
+static int socks[MAX_WORKERS][2];
+static int num_socks = 0;
+static shared_data_t* load_shm = NULL;
+static int self_id = -1;
+
+int rebalance_init(shared_data_t* shm, int num_workers) {
+    // Datagramas: cada mensagem leva exatamente um fd, sem framing
+    for (int i = 0; i < num_workers && i < MAX_WORKERS; i++) {
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, socks[i]) != 0) {
+            rebalance_destroy();
+            return -1;
+        }
+        num_socks++;
+    }
+    load_shm = shm;
+    return 0;
+}
+
+int rebalance_worker_init(shared_data_t* shm, int worker_id) {
+    if (num_socks == 0 || worker_id < 0 || worker_id >= num_socks) return -1;
+
+    // As pontas de receção dos outros workers não são usadas aqui
+    for (int i = 0; i < num_socks; i++) {
+        if (i != worker_id) {
+            close(socks[i][0]);
+            socks[i][0] = -1;
+        }
+    }
+    load_shm = shm;
+    self_id = worker_id;
+    atomic_store(&shm->worker_load[worker_id], 0);
+    return socks[worker_id][0];
+}
+
+void rebalance_publish_load(int load) {
+    if (self_id < 0) return;
+    atomic_store_explicit(&load_shm->worker_load[self_id], load, memory_order_relaxed);
+}
+
+// Worker com menos carga que ainda tem uma thread livre (-1 = nenhum)
+static int pick_target(int threads) {
+    int best = -1, best_load = threads;
+    for (int i = 0; i < num_socks; i++) {
+        if (i == self_id) continue;
+        int load = atomic_load_explicit(&load_shm->worker_load[i], memory_order_relaxed);
+        if (load >= 0 && load < best_load) {
+            best = i;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+static int send_fd(int sock, int fd) {
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) == 1 ? 0 : -1;
+}
+
+int rebalance_handoff(int client_fd, int threads) {
+    if (self_id < 0) return 0;
+
+    // 1. Só reencaminha com todas as threads deste worker ocupadas
+    int own = atomic_load_explicit(&load_shm->worker_load[self_id], memory_order_relaxed);
+    if (own < threads) return 0;
+
+    int target = pick_target(threads);
+    if (target < 0) return 0; // Todos cheios: fica aqui (a fila decide se há 503)
+
+    // 2. Enviar o fd; com o socket do destino cheio a conexão fica cá
+    if (send_fd(socks[target][1], client_fd) != 0) return 0;
+    close(client_fd); // O destino tem a sua própria cópia
+
+    // 3. Reservar o lugar já: as conexões seguintes do mesmo accept() não
+    // vão todas para o mesmo destino antes de ele publicar a carga real
+    atomic_fetch_add_explicit(&load_shm->worker_load[target], 1, memory_order_relaxed);
+    stats_connection_rebalanced();
+    return 1;
+}
+
+// Próximo fd na fila do socket 'sock': -1 se vazia, -2 se a mensagem não
+// trazia um fd (ignorada)
+static int recv_fd(int sock) {
+    char byte;
+    struct iovec iov = {&byte, 1};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC) <= 0) return -1;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return -2;
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+void rebalance_receive(event_loop_t* loop) {
+    if (self_id < 0) return;
+
+    int fd;
+    while ((fd = recv_fd(socks[self_id][0])) != -1) {
+        if (fd >= 0) event_loop_add(loop, fd); // Como uma conexão aceite por este worker
+    }
+}
+
+void rebalance_worker_down(int worker_id) {
+    if (!load_shm || worker_id < 0 || worker_id >= MAX_WORKERS) return;
+    atomic_store(&load_shm->worker_load[worker_id], -1);
+}
+
+void rebalance_drain(int worker_id) {
+    if (self_id >= 0 || worker_id < 0 || worker_id >= num_socks) return;
+
+    // Um emissor pode ter escolhido o worker antes de ele ficar a -1: o fd
+    // chega a uma fila que já ninguém lê. Fechá-lo termina a conexão em vez
+    // de a deixar pendurada até ao shutdown.
+    int fd;
+    while ((fd = recv_fd(socks[worker_id][0])) != -1) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+void rebalance_destroy(void) {
+    for (int i = 0; i < num_socks; i++) {
+        if (socks[i][0] >= 0) close(socks[i][0]);
+        close(socks[i][1]);
+    }
+    num_socks = 0;
+}
@@ -0,0 +1,43 @@
+// src/rebalance.h
+#ifndef REBALANCE_H
+#define REBALANCE_H
+
+#include "shared_mem.h"
+#include "event_loop.h"
+
+// Reencaminhamento de conexões entre workers (REBALANCE=1).
+// Cada worker publica a carga da sua thread pool (fila + pedidos em curso)
+// na SHM. Um worker com todas as threads ocupadas entrega as conexões que
+// acabou de aceitar ao worker menos carregado, passando o fd (SCM_RIGHTS)
+// pelo socketpair desse worker.
+
+// Master (antes do fork): um socketpair por worker. Devolve -1 em erro
+// (o servidor continua, sem reencaminhamento).
+int rebalance_init(shared_data_t* shm, int num_workers);
+
+// Worker: fica com a sua ponta de receção. Devolve o fd a registar no
+// epoll (-1 = reencaminhamento desligado).
+int rebalance_worker_init(shared_data_t* shm, int worker_id);
+
+// Thread pool (com o seu mutex): carga atual deste worker
+void rebalance_publish_load(int load);
+
+// Event loop, logo após o accept(): se este worker tem 'threads' ou mais
+// conexões na pool e outro tem uma thread livre, envia-lhe o fd e fecha a
+// cópia local. Devolve 1 se a conexão foi entregue.
+int rebalance_handoff(int client_fd, int threads);
+
+// Event loop: regista as conexões recebidas de outros workers
+void rebalance_receive(event_loop_t* loop);
+
+// Worker a terminar / Master ao detetar um worker morto: deixa de receber
+void rebalance_worker_down(int worker_id);
+
+// Master, a cada ciclo, para cada worker morto: fecha as conexões que
+// ficaram na sua fila (enviadas pouco antes de ele ficar marcado a -1)
+void rebalance_drain(int worker_id);
+
+// Master: fecha os socketpairs
+void rebalance_destroy(void);
+
+#endif
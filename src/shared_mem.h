@@ -3,33 +3,95 @@
 #define SHARED_MEM_H
 
 #include <time.h>
+#include <stdatomic.h>
 
 #define MAX_QUEUE_SIZE 100
+#define MAX_WORKERS 16
+#define STATS_SLOTS_PER_WORKER 64 // Event loop + threads da pool
 
+// Histograma log-linear (estilo HDR) de latências em microssegundos:
+// valores < 16us são exatos; acima disso cada potência de 2 tem 16
+// sub-buckets (erro relativo <= 6.25%). Vai até 2^32us (~71 minutos).
+#define LAT_SUB_BITS 4
+#define LAT_SUB_BUCKETS (1 << LAT_SUB_BITS)
+#define LAT_MAX_EXP 32
+#define LAT_BUCKETS ((LAT_MAX_EXP - LAT_SUB_BITS + 2) * LAT_SUB_BUCKETS)
+
+typedef enum {
+    LAT_CACHE_HIT = 0,
+    LAT_CACHE_MISS,
+    LAT_CGI,
+    LAT_ERROR,
+    LAT_CLASSES
+} latency_class_t;
+
+// Vista agregada das estatísticas (resultado de stats_snapshot)
 typedef struct {
     long total_requests;
     long bytes_transferred;
     long status_200;
+    long status_304;
     long status_403;
     long status_404;
     long status_500;
     int active_connections;
 
     time_t start_time;
-    long total_response_time_ms;
+    long total_response_time_us;
     long cache_hits;
+    long requests_shed; // Conexões recusadas com 503 (fila cheia)
+    int queue_depth;    // Conexões à espera de uma thread (todos os workers)
+    int pool_threads;   // Threads vivas nas thread pools (todos os workers)
+    long connections_rebalanced; // Conexões entregues a outro worker (SCM_RIGHTS)
 } server_stats_t;
 
+// Percentis calculados a partir dos histogramas (stats_latency)
+typedef struct {
+    long count;
+    long p50_us;
+    long p90_us;
+    long p99_us;
+    long p999_us;
+    long max_us;
+} latency_summary_t;
+
+// Um histograma por worker e por classe. Várias threads do mesmo worker
+// incrementam os buckets com atomic_fetch_add relaxed (sem locks).
 typedef struct {
-    int sockets[MAX_QUEUE_SIZE];
-    int front;
-    int rear;
-    int count;
-} connection_queue_t;
+    atomic_long counts[LAT_BUCKETS];
+    atomic_long max_us;
+} latency_hist_t;
 
+// Contadores de UMA thread de UM worker. Só essa thread escreve no slot,
+// por isso não há locks: o leitor usa o 'seq' (seqlock) para obter uma
+// cópia consistente. Alinhado a 64 bytes para não partilhar cache lines.
 typedef struct {
-    connection_queue_t queue;
-    server_stats_t stats;
+    atomic_uint seq; // Ímpar = escrita em curso
+    atomic_long total_requests;
+    atomic_long bytes_transferred;
+    atomic_long status_200;
+    atomic_long status_304;
+    atomic_long status_403;
+    atomic_long status_404;
+    atomic_long status_500;
+    atomic_long total_response_time_us;
+    atomic_long cache_hits;
+    atomic_long connections_opened;
+    atomic_long connections_closed;
+    atomic_long requests_shed;
+    atomic_long connections_rebalanced;
+} __attribute__((aligned(64))) stats_slot_t;
+
+typedef struct {
+    time_t start_time;
+    // Log de acessos: bytes no ficheiro atual e geração (incrementa a cada rotação)
+    atomic_long log_size;
+    atomic_uint log_generation;
+    stats_slot_t stats_slots[MAX_WORKERS * STATS_SLOTS_PER_WORKER];
+    atomic_int queue_depth[MAX_WORKERS]; // Fila da thread pool de cada worker
+    atomic_int pool_threads[MAX_WORKERS]; // Tamanho atual da thread pool de cada worker
+    atomic_int worker_load[MAX_WORKERS]; // Fila + pedidos em curso (-1 = worker em baixo)
+    latency_hist_t latency[MAX_WORKERS][LAT_CLASSES];
 } shared_data_t;
 
 shared_data_t* create_shared_memory();
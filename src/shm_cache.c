@@ -0,0 +1,420 @@
+// src/shm_cache.c
+#define _POSIX_C_SOURCE 200809L
+#include "shm_cache.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#define OBJECT_MAGIC 0x57534348u // "WSCH"
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+// --- Acesso às regiões do segmento (por offset) ---
+static shm_cache_slot_t* slots(shm_cache_header_t* h) {
+    return (shm_cache_slot_t*)((char*)h + h->slots_off);
+}
+static int32_t* buckets(shm_cache_header_t* h) {
+    return (int32_t*)((char*)h + h->buckets_off);
+}
+static int8_t* orders(shm_cache_header_t* h) {
+    return (int8_t*)h + h->order_off;
+}
+static int32_t (*links(shm_cache_header_t* h))[2] {
+    return (int32_t (*)[2])((char*)h + h->links_off);
+}
+static char* block_ptr(shm_cache_header_t* h, uint32_t block) {
+    return (char*)h + h->arena_off + (size_t)block * SHM_CACHE_BLOCK_SIZE;
+}
+
+static uint64_t hash_key(const char* key) {
+    uint64_t h = 14695981039346656037ULL;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Mutexes robustos: se um worker morrer com o lock, o próximo recupera-o
+static void lock_robust(pthread_mutex_t* m) {
+    if (pthread_mutex_lock(m) == EOWNERDEAD) pthread_mutex_consistent(m);
+}
+
+static pthread_mutex_t* stripe_for(shm_cache_header_t* h, uint64_t hash) {
+    return &h->stripes[hash & (SHM_CACHE_STRIPES - 1)];
+}
+
+static int total_refs(shm_cache_slot_t* s) {
+    int refs = 0;
+    for (int w = 0; w < MAX_WORKERS; w++) refs += atomic_load(&s->refs[w]);
+    return refs;
+}
+
+// --- Alocador de blocos (buddy, com listas livres por ordem) ---
+// Nota: Todas as funções abaixo assumem que o alloc_lock já está adquirido!
+
+static void area_push(shm_cache_header_t* h, uint32_t block, int order) {
+    int32_t (*l)[2] = links(h);
+    int32_t head = h->free_area[order];
+    l[block][0] = head;
+    l[block][1] = -1;
+    if (head != -1) l[head][1] = block;
+    h->free_area[order] = block;
+    orders(h)[block] = order;
+}
+
+static void area_remove(shm_cache_header_t* h, uint32_t block, int order) {
+    int32_t (*l)[2] = links(h);
+    if (l[block][1] != -1) l[l[block][1]][0] = l[block][0];
+    else h->free_area[order] = l[block][0];
+    if (l[block][0] != -1) l[l[block][0]][1] = l[block][1];
+    orders(h)[block] = -1;
+}
+
+// Devolve uma área alinhada, fundindo-a com o buddy enquanto ele estiver livre
+static void area_free(shm_cache_header_t* h, uint32_t block, int order) {
+    while (order + 1 < SHM_CACHE_MAX_ORDER) {
+        uint32_t buddy = block ^ (1u << order);
+        if (buddy >= h->num_blocks || orders(h)[buddy] != order) break;
+        area_remove(h, buddy, order);
+        block &= ~(1u << order);
+        order++;
+    }
+    area_push(h, block, order);
+}
+
+// Devolve [first, first + n) partido nas maiores áreas alinhadas possíveis
+static void free_range(shm_cache_header_t* h, uint32_t first, uint32_t n) {
+    uint32_t end = first + n;
+    while (first < end) {
+        int order = first ? __builtin_ctz(first) : SHM_CACHE_MAX_ORDER - 1;
+        while (order > 0 && (1u << order) > end - first) order--;
+        area_free(h, first, order);
+        first += 1u << order;
+    }
+}
+
+// n blocos contíguos: a menor área livre que chega; a sobra volta às listas
+static int64_t alloc_blocks(shm_cache_header_t* h, uint32_t n) {
+    int want = 0;
+    while ((1u << want) < n) want++;
+    int order = want;
+    while (order < SHM_CACHE_MAX_ORDER && h->free_area[order] == -1) order++;
+    if (order == SHM_CACHE_MAX_ORDER) return -1;
+
+    uint32_t first = h->free_area[order];
+    area_remove(h, first, order);
+    free_range(h, first + n, (1u << order) - n);
+    return first;
+}
+
+static void free_object(shm_cache_header_t* h, int32_t idx) {
+    shm_cache_slot_t* s = &slots(h)[idx];
+    free_range(h, s->first_block, s->num_blocks);
+    h->current_size -= s->size;
+    s->next = h->free_slot;
+    h->free_slot = idx;
+    atomic_store(&s->state, SLOT_FREE);
+}
+
+// --- Índice ---
+
+// Uma entrada DEAD sem referências volta ao alocador. Quem larga a última
+// referência e quem a retira do índice podem chegar aqui ao mesmo tempo:
+// o CAS garante que só um a liberta.
+static void try_free_dead(shm_cache_header_t* h, int32_t idx) {
+    shm_cache_slot_t* s = &slots(h)[idx];
+    int dead = SLOT_DEAD;
+    if (total_refs(s) != 0 || !atomic_compare_exchange_strong(&s->state, &dead, SLOT_FREEING)) return;
+    lock_robust(&h->alloc_lock);
+    free_object(h, idx);
+    pthread_mutex_unlock(&h->alloc_lock);
+}
+
+// Retira uma entrada LIVE do índice; só é libertada quando não houver referências
+// Nota: assume que o lock da stripe da entrada já está adquirido!
+static void unlink_live(shm_cache_header_t* h, int32_t idx) {
+    shm_cache_slot_t* all = slots(h);
+    int32_t* link = &buckets(h)[all[idx].hash & (h->num_buckets - 1)];
+    while (*link != -1) {
+        if (*link == idx) {
+            *link = all[idx].next;
+            break;
+        }
+        link = &all[*link].next;
+    }
+    atomic_store(&all[idx].state, SLOT_DEAD);
+    try_free_dead(h, idx);
+}
+
+// Nota: assume que o lock da stripe de 'hash' já está adquirido!
+static int32_t find_live(shm_cache_header_t* h, const char* key, uint64_t hash) {
+    shm_cache_slot_t* all = slots(h);
+    int32_t idx = buckets(h)[hash & (h->num_buckets - 1)];
+    while (idx != -1) {
+        if (all[idx].hash == hash && strcmp((char*)h + all[idx].key_off, key) == 0) return idx;
+        idx = all[idx].next;
+    }
+    return -1;
+}
+
+// CLOCK sobre os slots: as entradas usadas desde a última passagem perdem
+// o bit e ficam; a primeira sem bit e sem referências sai. Stripes ocupadas
+// são saltadas (trylock), para nunca esperar com outro lock na mão.
+static int evict_one(shm_cache_header_t* h) {
+    shm_cache_slot_t* all = slots(h);
+    for (int32_t scanned = 0; scanned < 2 * h->num_slots; scanned++) {
+        int32_t idx = atomic_fetch_add(&h->clock_hand, 1) % (uint32_t)h->num_slots;
+        shm_cache_slot_t* s = &all[idx];
+        if (atomic_load(&s->state) != SLOT_LIVE) continue;
+        if (atomic_exchange(&s->referenced, 0)) continue; // Segunda oportunidade
+        if (total_refs(s) != 0) continue;
+
+        uint64_t hash = s->hash;
+        pthread_mutex_t* m = stripe_for(h, hash);
+        int rc = pthread_mutex_trylock(m);
+        if (rc == EOWNERDEAD) pthread_mutex_consistent(m);
+        else if (rc != 0) continue;
+
+        // Confirmar com o lock (o slot pode ter sido reutilizado entretanto)
+        int evicted = atomic_load(&s->state) == SLOT_LIVE && s->hash == hash && total_refs(s) == 0;
+        if (evicted) unlink_live(h, idx);
+        pthread_mutex_unlock(m);
+        if (evicted) return 0;
+    }
+    return -1;
+}
+
+// --- Criação / Ligação ---
+
+static shm_cache_t* map_segment(int fd, size_t size) {
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    shm_cache_t* cache = malloc(sizeof(shm_cache_t));
+    if (!cache) {
+        munmap(base, size);
+        return NULL;
+    }
+    cache->hdr = base;
+    cache->map_size = size;
+    cache->worker = 0;
+    return cache;
+}
+
+shm_cache_t* shm_cache_create(size_t max_size_mb) {
+    size_t max_size = max_size_mb * 1024 * 1024;
+    uint32_t num_blocks = max_size / SHM_CACHE_BLOCK_SIZE;
+    if (num_blocks == 0) return NULL;
+
+    // Cada objeto ocupa pelo menos um bloco: nunca há mais objetos do que blocos
+    int32_t num_slots = num_blocks;
+    int32_t num_buckets = SHM_CACHE_STRIPES;
+    while (num_buckets < num_slots) num_buckets <<= 1;
+
+    size_t slots_off = ALIGN8(sizeof(shm_cache_header_t));
+    size_t buckets_off = ALIGN8(slots_off + sizeof(shm_cache_slot_t) * num_slots);
+    size_t order_off = ALIGN8(buckets_off + sizeof(int32_t) * num_buckets);
+    size_t links_off = ALIGN8(order_off + num_blocks);
+    size_t arena_off = ALIGN8(links_off + sizeof(int32_t) * 2 * num_blocks);
+    size_t total = arena_off + (size_t)num_blocks * SHM_CACHE_BLOCK_SIZE;
+
+    int fd = shm_open(SHM_CACHE_NAME, O_CREAT | O_RDWR, 0666);
+    if (fd == -1) return NULL;
+    if (ftruncate(fd, total) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    shm_cache_t* cache = map_segment(fd, total);
+    if (!cache) return NULL;
+
+    shm_cache_header_t* h = cache->hdr;
+    memset(h, 0, arena_off); // A arena fica a zeros pelo ftruncate
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    for (int i = 0; i < SHM_CACHE_STRIPES; i++) pthread_mutex_init(&h->stripes[i], &attr);
+    pthread_mutex_init(&h->alloc_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    h->total_size = total;
+    h->max_size = max_size;
+    h->current_size = 0;
+    atomic_init(&h->clock_hand, 0);
+    h->num_slots = num_slots;
+    h->num_buckets = num_buckets;
+    h->num_blocks = num_blocks;
+    h->slots_off = slots_off;
+    h->buckets_off = buckets_off;
+    h->order_off = order_off;
+    h->links_off = links_off;
+    h->arena_off = arena_off;
+
+    // Todos os slots livres, encadeados
+    shm_cache_slot_t* all = slots(h);
+    for (int32_t i = 0; i < num_slots; i++) {
+        all[i].state = SLOT_FREE;
+        all[i].next = (i + 1 < num_slots) ? i + 1 : -1;
+    }
+    h->free_slot = 0;
+
+    int32_t* b = buckets(h);
+    for (int32_t i = 0; i < num_buckets; i++) b[i] = -1;
+
+    // Arena inteira livre, partida em áreas alinhadas
+    memset(orders(h), -1, num_blocks);
+    for (int i = 0; i < SHM_CACHE_MAX_ORDER; i++) h->free_area[i] = -1;
+    free_range(h, 0, num_blocks);
+
+    return cache;
+}
+
+shm_cache_t* shm_cache_attach(int worker_id) {
+    int fd = shm_open(SHM_CACHE_NAME, O_RDWR, 0666);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return NULL;
+    }
+    shm_cache_t* cache = map_segment(fd, st.st_size);
+    if (cache) cache->worker = (worker_id >= 0 && worker_id < MAX_WORKERS) ? worker_id : 0;
+    return cache;
+}
+
+// --- Operações ---
+
+const void* shm_cache_get(shm_cache_t* cache, const char* key, size_t* out_size) {
+    shm_cache_header_t* h = cache->hdr;
+    const void* data = NULL;
+    uint64_t hash = hash_key(key);
+
+    // Só a stripe da key: hits de paths diferentes não se bloqueiam
+    pthread_mutex_t* m = stripe_for(h, hash);
+    lock_robust(m);
+    int32_t idx = find_live(h, key, hash);
+    if (idx != -1) {
+        shm_cache_slot_t* s = &slots(h)[idx];
+        atomic_fetch_add(&s->refs[cache->worker], 1);
+        atomic_store_explicit(&s->referenced, 1, memory_order_relaxed);
+        data = (char*)h + s->data_off;
+        if (out_size) *out_size = s->size;
+    }
+    pthread_mutex_unlock(m);
+
+    return data;
+}
+
+const cache_meta_t* shm_cache_meta(const void* data) {
+    return &((const shm_object_hdr_t*)data - 1)->meta;
+}
+
+void shm_cache_release(shm_cache_t* cache, const void* data) {
+    if (!data) return;
+    shm_cache_header_t* h = cache->hdr;
+    const shm_object_hdr_t* obj = (const shm_object_hdr_t*)data - 1;
+    if (obj->magic != OBJECT_MAGIC) return;
+
+    // Sem locks: só uma entrada já retirada do índice pode ter de ser libertada
+    shm_cache_slot_t* s = &slots(h)[obj->slot];
+    atomic_fetch_sub(&s->refs[cache->worker], 1);
+    if (atomic_load(&s->state) == SLOT_DEAD) try_free_dead(h, obj->slot);
+}
+
+void shm_cache_put(shm_cache_t* cache, const char* key, const void* data, size_t size,
+                   const cache_meta_t* meta) {
+    shm_cache_header_t* h = cache->hdr;
+    size_t key_len = strlen(key);
+    size_t need = ALIGN8(key_len + 1) + sizeof(shm_object_hdr_t) + size;
+    uint32_t nblocks = (need + SHM_CACHE_BLOCK_SIZE - 1) / SHM_CACHE_BLOCK_SIZE;
+    if (nblocks > h->num_blocks) return; // Nunca caberia
+
+    // 1. Reservar slot e blocos; sem espaço, o CLOCK liberta entradas
+    // (fora do alloc_lock: a eviction precisa do lock da stripe primeiro)
+    int64_t first;
+    while (1) {
+        lock_robust(&h->alloc_lock);
+        if (h->free_slot != -1 && (first = alloc_blocks(h, nblocks)) >= 0) break;
+        pthread_mutex_unlock(&h->alloc_lock);
+        if (evict_one(h) != 0) return;
+    }
+    int32_t idx = h->free_slot;
+    shm_cache_slot_t* s = &slots(h)[idx];
+    h->free_slot = s->next;
+    s->owner = cache->worker;
+    for (int w = 0; w < MAX_WORKERS; w++) atomic_store(&s->refs[w], 0);
+    s->first_block = first;
+    s->num_blocks = nblocks;
+    s->size = size;
+    h->current_size += size;
+    atomic_store(&s->state, SLOT_RESERVED);
+    pthread_mutex_unlock(&h->alloc_lock);
+
+    // 2. Copiar fora do lock: ninguém vê um slot RESERVED
+    char* base = block_ptr(h, first);
+    memcpy(base, key, key_len + 1);
+    shm_object_hdr_t* obj = (shm_object_hdr_t*)(base + ALIGN8(key_len + 1));
+    obj->slot = idx;
+    obj->magic = OBJECT_MAGIC;
+    if (meta) obj->meta = *meta;
+    else memset(&obj->meta, 0, sizeof(obj->meta));
+    memcpy(obj + 1, data, size);
+
+    s->hash = hash_key(key);
+    s->key_len = key_len;
+    s->key_off = base - (char*)h;
+    s->data_off = (char*)(obj + 1) - (char*)h;
+
+    // 3. Publicar (substitui uma versão anterior, se outro worker a inseriu)
+    pthread_mutex_t* m = stripe_for(h, s->hash);
+    lock_robust(m);
+    int32_t old = find_live(h, key, s->hash);
+    if (old != -1) unlink_live(h, old);
+
+    atomic_store(&s->referenced, 1);
+    int32_t* bucket = &buckets(h)[s->hash & (h->num_buckets - 1)];
+    s->next = *bucket;
+    *bucket = idx;
+    atomic_store(&s->state, SLOT_LIVE);
+    pthread_mutex_unlock(m);
+}
+
+void shm_cache_release_worker(shm_cache_t* cache, int worker_id) {
+    if (!cache || worker_id < 0 || worker_id >= MAX_WORKERS) return;
+    shm_cache_header_t* h = cache->hdr;
+    shm_cache_slot_t* all = slots(h);
+
+    for (int32_t i = 0; i < h->num_slots; i++) {
+        shm_cache_slot_t* s = &all[i];
+        int state = atomic_load(&s->state);
+
+        // Reservado por ele e nunca publicado: só volta ao alocador
+        if (state == SLOT_RESERVED && s->owner == worker_id) {
+            lock_robust(&h->alloc_lock);
+            free_object(h, i);
+            pthread_mutex_unlock(&h->alloc_lock);
+            continue;
+        }
+        if (atomic_exchange(&s->refs[worker_id], 0) > 0 && state == SLOT_DEAD) try_free_dead(h, i);
+    }
+}
+
+void shm_cache_detach(shm_cache_t* cache) {
+    if (!cache) return;
+    munmap(cache->hdr, cache->map_size);
+    free(cache);
+}
+
+void shm_cache_destroy(shm_cache_t* cache) {
+    shm_cache_detach(cache);
+    shm_unlink(SHM_CACHE_NAME);
+}
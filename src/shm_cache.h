@@ -0,0 +1,116 @@
+// src/shm_cache.h
+#ifndef SHM_CACHE_H
+#define SHM_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "shared_mem.h" // MAX_WORKERS
+
+#define SHM_CACHE_NAME "/webserver_cache"
+#define SHM_CACHE_BLOCK_SIZE 1024
+#define SHM_CACHE_STRIPES 64    // Locks do índice (por hash); potência de 2
+#define SHM_CACHE_MAX_ORDER 32  // Áreas livres de 2^0 a 2^31 blocos
+
+// Cache de ficheiros partilhada por todos os workers (POSIX SHM).
+// O segmento guarda apenas offsets: cada processo mapeia-o num endereço diferente.
+//
+// Layout: [header][slots][buckets][ordens][ligações][arena de blocos]
+// Cada objeto ocupa blocos contíguos na arena: [key\0 + padding][shm_object_hdr_t][dados]
+// (o header fica imediatamente antes dos dados para o release encontrar o slot)
+//
+// Sincronização:
+// - Índice: um mutex por stripe de buckets; um hit só bloqueia a sua stripe
+// - Referências e bit do CLOCK: atómicos; o release não usa locks
+// - Alocador (slots livres + blocos): alloc_lock. Ordem: stripe -> alloc_lock
+// - Refs contadas por worker: o Master liberta as de um worker que morreu
+
+typedef enum {
+    SLOT_FREE = 0,
+    SLOT_RESERVED, // A ser preenchida fora do lock (invisível)
+    SLOT_LIVE,     // Visível nos lookups
+    SLOT_DEAD,     // Substituída mas ainda com referências
+    SLOT_FREEING   // Última referência largada: a ser devolvida ao alocador
+} shm_slot_state_t;
+
+typedef struct {
+    atomic_int state;
+    int32_t next;          // Cadeia no bucket (LIVE) ou free list (FREE)
+    int32_t owner;         // Worker que reservou o slot (RESERVED)
+    atomic_int referenced; // Bit de referência do CLOCK
+    atomic_int refs[MAX_WORKERS]; // Senders de cada worker que ainda estão a usar os dados
+    uint32_t first_block;
+    uint32_t num_blocks;
+    uint32_t key_len;
+    uint64_t hash;
+    uint64_t key_off;      // Offsets desde o início do segmento
+    uint64_t data_off;
+    uint64_t size;
+} shm_cache_slot_t;
+
+// Metadados guardados junto com o corpo (cache privada e partilhada):
+// permitem responder 304 e montar os headers sem tocar no disco.
+// Só arrays (sem ponteiros): o mesmo layout serve dentro do segmento SHM.
+typedef struct {
+    char etag[48];          // Forte, com aspas: "inode-tamanho-mtime"
+    char last_modified[32]; // IMF-fixdate (GMT)
+    char mime[40];          // Do ficheiro original (também nas variantes gzip)
+    int64_t mtime;
+    int32_t gzip;           // 1 = corpo comprimido (Content-Encoding: gzip)
+    int64_t expires;        // Micro-cache CGI: fresca até este instante (time()); 0 = ficheiro estático
+} cache_meta_t;
+
+typedef struct {
+    cache_meta_t meta;
+    int32_t slot;
+    uint32_t magic;
+} shm_object_hdr_t;
+
+typedef struct {
+    pthread_mutex_t stripes[SHM_CACHE_STRIPES]; // PROCESS_SHARED + ROBUST
+    pthread_mutex_t alloc_lock;                 // Idem: slots livres e blocos
+    size_t total_size;     // Tamanho do segmento
+    size_t max_size;       // Bytes disponíveis para objetos (CACHE_SIZE_MB)
+    size_t current_size;   // Bytes de dados em cache (alloc_lock)
+    atomic_uint clock_hand;
+    int32_t num_slots;
+    int32_t num_buckets;   // Potência de 2, >= SHM_CACHE_STRIPES
+    int32_t free_slot;     // Início da free list de slots
+    uint32_t num_blocks;
+    int32_t free_area[SHM_CACHE_MAX_ORDER]; // Buddy: primeira área livre de cada ordem (-1 = nenhuma)
+    uint64_t slots_off;
+    uint64_t buckets_off;
+    uint64_t order_off;    // int8_t por bloco: ordem se inicia uma área livre, -1 se não
+    uint64_t links_off;    // int32_t[2] por bloco: next/prev na lista da sua ordem
+    uint64_t arena_off;
+} shm_cache_header_t;
+
+// Vista local (por processo) do segmento
+typedef struct {
+    shm_cache_header_t* hdr;
+    size_t map_size;
+    int worker;            // Índice nas refs por worker
+} shm_cache_t;
+
+// Master: cria e inicializa o segmento
+shm_cache_t* shm_cache_create(size_t max_size_mb);
+// Workers: mapeiam o segmento criado pelo Master
+shm_cache_t* shm_cache_attach(int worker_id);
+
+const void* shm_cache_get(shm_cache_t* cache, const char* key, size_t* out_size);
+const cache_meta_t* shm_cache_meta(const void* data);
+void shm_cache_release(shm_cache_t* cache, const void* data);
+void shm_cache_put(shm_cache_t* cache, const char* key, const void* data, size_t size,
+                   const cache_meta_t* meta);
+
+// Master: um worker morreu; larga as referências que ele tinha e os
+// slots que deixou reservados (senão ficavam por libertar para sempre)
+void shm_cache_release_worker(shm_cache_t* cache, int worker_id);
+
+void shm_cache_detach(shm_cache_t* cache);
+// Master: desmapeia e remove o segmento
+void shm_cache_destroy(shm_cache_t* cache);
+
+#endif
@@ -2,55 +2,308 @@
 #include "stats.h"
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
 
-void update_stats(shared_data_t* data, semaphores_t* sems, 
-                  int status, size_t bytes, long response_time_ms, int is_cache_hit) {
-    sem_wait(sems->stats_mutex);
-    
-    data->stats.total_requests++;
-    data->stats.bytes_transferred += bytes;
-    
-    if (status == 200) data->stats.status_200++;
-    else if (status == 404) data->stats.status_404++;
-    else if (status == 403) data->stats.status_403++;
-    else if (status == 500) data->stats.status_500++;
-    
-    data->stats.total_response_time_ms += response_time_ms;
-    if (is_cache_hit) data->stats.cache_hits++;
-    
-    sem_post(sems->stats_mutex);
+// Estado do processo worker atual
+static shared_data_t* stats_shm = NULL;
+static int stats_worker_id = -1;
+
+// Slots livres deste worker (só se mexe quando threads nascem ou terminam)
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
+static int slot_in_use[STATS_SLOTS_PER_WORKER];
+
+// Slot da thread atual (NULL = thread sem slot, não conta)
+static __thread stats_slot_t* my_slot = NULL;
+static __thread int my_slot_idx = -1;
+
+#define SLOT_LOAD(slot, field) atomic_load_explicit(&(slot)->field, memory_order_relaxed)
+
+// Único escritor: load + store relaxed (sem instruções atómicas read-modify-write)
+#define SLOT_ADD(slot, field, value) \
+    atomic_store_explicit(&(slot)->field, SLOT_LOAD(slot, field) + (value), memory_order_relaxed)
+
+static void write_begin(stats_slot_t* slot) {
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(stats_slot_t* slot) {
+    unsigned seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+}
+
+void stats_init_worker(shared_data_t* data, int worker_id) {
+    stats_shm = data;
+    stats_worker_id = (worker_id >= 0 && worker_id < MAX_WORKERS) ? worker_id : -1;
+}
+
+void stats_bind_thread(void) {
+    if (!stats_shm || stats_worker_id < 0 || my_slot) return;
+
+    pthread_mutex_lock(&slot_lock);
+    for (int i = 0; i < STATS_SLOTS_PER_WORKER; i++) {
+        if (!slot_in_use[i]) {
+            // Os contadores são cumulativos: um slot reutilizado continua a somar
+            slot_in_use[i] = 1;
+            my_slot_idx = i;
+            my_slot = &stats_shm->stats_slots[stats_worker_id * STATS_SLOTS_PER_WORKER + i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&slot_lock);
+
+    if (!my_slot) fprintf(stderr, "Stats: sem slots livres para a thread\n");
+}
+
+void stats_unbind_thread(void) {
+    if (!my_slot) return;
+    pthread_mutex_lock(&slot_lock);
+    slot_in_use[my_slot_idx] = 0;
+    pthread_mutex_unlock(&slot_lock);
+    my_slot = NULL;
+    my_slot_idx = -1;
+}
+
+long stats_elapsed_us(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+// Índice do bucket log-linear para 'us'
+static int latency_bucket(unsigned long us) {
+    if (us < LAT_SUB_BUCKETS) return (int)us;
+    int exp = 63 - __builtin_clzl(us); // floor(log2(us))
+    if (exp > LAT_MAX_EXP) return LAT_BUCKETS - 1;
+    int sub = (us >> (exp - LAT_SUB_BITS)) & (LAT_SUB_BUCKETS - 1);
+    return (exp - LAT_SUB_BITS + 1) * LAT_SUB_BUCKETS + sub;
+}
+
+// Maior valor que cai no bucket (como no HDR: reporta-se o limite superior)
+static long latency_bucket_max(int idx) {
+    if (idx < LAT_SUB_BUCKETS) return idx;
+    int exp = idx / LAT_SUB_BUCKETS + LAT_SUB_BITS - 1;
+    int sub = idx % LAT_SUB_BUCKETS;
+    long width = 1L << (exp - LAT_SUB_BITS);
+    return ((long)(LAT_SUB_BUCKETS + sub) << (exp - LAT_SUB_BITS)) + width - 1;
+}
+
+static void record_latency(latency_class_t cls, long us) {
+    if (!stats_shm || stats_worker_id < 0 || cls >= LAT_CLASSES) return;
+    if (us < 0) us = 0;
+
+    latency_hist_t* hist = &stats_shm->latency[stats_worker_id][cls];
+    atomic_fetch_add_explicit(&hist->counts[latency_bucket(us)], 1, memory_order_relaxed);
+
+    long max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+    while (us > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max_us, &max, us,
+                                                  memory_order_relaxed, memory_order_relaxed));
+}
+
+void update_stats(int status, size_t bytes, long response_time_us, latency_class_t cls) {
+    // Erros contam sempre na classe de erro, seja qual for o caminho
+    if (status >= 400) cls = LAT_ERROR;
+    record_latency(cls, response_time_us);
+
+    stats_slot_t* slot = my_slot;
+    if (!slot) return;
+
+    write_begin(slot);
+    SLOT_ADD(slot, total_requests, 1);
+    SLOT_ADD(slot, bytes_transferred, (long)bytes);
+
+    if (status == 200) SLOT_ADD(slot, status_200, 1);
+    else if (status == 304) SLOT_ADD(slot, status_304, 1);
+    else if (status == 404) SLOT_ADD(slot, status_404, 1);
+    else if (status == 403) SLOT_ADD(slot, status_403, 1);
+    else if (status == 500) SLOT_ADD(slot, status_500, 1);
+
+    SLOT_ADD(slot, total_response_time_us, response_time_us);
+    if (cls == LAT_CACHE_HIT) SLOT_ADD(slot, cache_hits, 1);
+    write_end(slot);
+}
+
+void stats_connection_opened(void) {
+    stats_slot_t* slot = my_slot;
+    if (!slot) return;
+    write_begin(slot);
+    SLOT_ADD(slot, connections_opened, 1);
+    write_end(slot);
+}
+
+void stats_connection_closed(int count) {
+    stats_slot_t* slot = my_slot;
+    if (!slot || count <= 0) return;
+    write_begin(slot);
+    SLOT_ADD(slot, connections_closed, count);
+    write_end(slot);
+}
+
+void stats_queue_depth(int depth) {
+    if (!stats_shm || stats_worker_id < 0) return;
+    atomic_store_explicit(&stats_shm->queue_depth[stats_worker_id], depth, memory_order_relaxed);
+}
+
+void stats_pool_threads(int threads) {
+    if (!stats_shm || stats_worker_id < 0) return;
+    atomic_store_explicit(&stats_shm->pool_threads[stats_worker_id], threads, memory_order_relaxed);
+}
+
+void stats_request_shed(void) {
+    stats_slot_t* slot = my_slot;
+    if (!slot) return;
+    write_begin(slot);
+    SLOT_ADD(slot, requests_shed, 1);
+    write_end(slot);
+}
+
+void stats_connection_rebalanced(void) {
+    stats_slot_t* slot = my_slot;
+    if (!slot) return;
+    write_begin(slot);
+    SLOT_ADD(slot, connections_rebalanced, 1);
+    write_end(slot);
 }
 
-void display_stats(shared_data_t* data, semaphores_t* sems) {
-    sem_wait(sems->stats_mutex);
+// Lê uma cópia consistente de um slot (repete se o escritor estava a meio)
+static void read_slot(stats_slot_t* slot, server_stats_t* part, long* opened, long* closed) {
+    unsigned seq1, seq2;
+    do {
+        seq1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        part->total_requests = SLOT_LOAD(slot, total_requests);
+        part->bytes_transferred = SLOT_LOAD(slot, bytes_transferred);
+        part->status_200 = SLOT_LOAD(slot, status_200);
+        part->status_304 = SLOT_LOAD(slot, status_304);
+        part->status_403 = SLOT_LOAD(slot, status_403);
+        part->status_404 = SLOT_LOAD(slot, status_404);
+        part->status_500 = SLOT_LOAD(slot, status_500);
+        part->total_response_time_us = SLOT_LOAD(slot, total_response_time_us);
+        part->cache_hits = SLOT_LOAD(slot, cache_hits);
+        part->requests_shed = SLOT_LOAD(slot, requests_shed);
+        part->connections_rebalanced = SLOT_LOAD(slot, connections_rebalanced);
+        *opened = SLOT_LOAD(slot, connections_opened);
+        *closed = SLOT_LOAD(slot, connections_closed);
+        atomic_thread_fence(memory_order_acquire);
+        seq2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    } while ((seq1 & 1) || seq1 != seq2);
+}
+
+void stats_snapshot(shared_data_t* data, server_stats_t* out) {
+    long total_opened = 0, total_closed = 0;
+    *out = (server_stats_t){0};
+    out->start_time = data->start_time;
+
+    for (int i = 0; i < MAX_WORKERS * STATS_SLOTS_PER_WORKER; i++) {
+        server_stats_t part;
+        long opened, closed;
+        read_slot(&data->stats_slots[i], &part, &opened, &closed);
+
+        out->total_requests += part.total_requests;
+        out->bytes_transferred += part.bytes_transferred;
+        out->status_200 += part.status_200;
+        out->status_304 += part.status_304;
+        out->status_403 += part.status_403;
+        out->status_404 += part.status_404;
+        out->status_500 += part.status_500;
+        out->total_response_time_us += part.total_response_time_us;
+        out->cache_hits += part.cache_hits;
+        out->requests_shed += part.requests_shed;
+        out->connections_rebalanced += part.connections_rebalanced;
+        total_opened += opened;
+        total_closed += closed;
+    }
+
+    out->active_connections = (int)(total_opened - total_closed);
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        out->queue_depth += atomic_load_explicit(&data->queue_depth[w], memory_order_relaxed);
+        out->pool_threads += atomic_load_explicit(&data->pool_threads[w], memory_order_relaxed);
+    }
+}
+
+const char* stats_latency_class_name(latency_class_t cls) {
+    switch (cls) {
+        case LAT_CACHE_HIT:  return "Cache Hit";
+        case LAT_CACHE_MISS: return "Cache Miss";
+        case LAT_CGI:        return "CGI";
+        case LAT_ERROR:      return "Error";
+        default:             return "?";
+    }
+}
+
+void stats_latency(shared_data_t* data, latency_class_t cls, latency_summary_t* out) {
+    static const double quantiles[] = {0.50, 0.90, 0.99, 0.999};
+    long* targets[] = {&out->p50_us, &out->p90_us, &out->p99_us, &out->p999_us};
+    long counts[LAT_BUCKETS] = {0};
+
+    *out = (latency_summary_t){0};
+    for (int w = 0; w < MAX_WORKERS; w++) {
+        latency_hist_t* hist = &data->latency[w][cls];
+        for (int i = 0; i < LAT_BUCKETS; i++) {
+            long c = atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+            counts[i] += c;
+            out->count += c;
+        }
+        long max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+        if (max > out->max_us) out->max_us = max;
+    }
+    if (out->count == 0) return;
+
+    // Percorre os buckets uma vez, preenchendo os percentis por ordem
+    long seen = 0;
+    int q = 0;
+    for (int i = 0; i < LAT_BUCKETS && q < 4; i++) {
+        seen += counts[i];
+        while (q < 4 && seen >= (long)(quantiles[q] * out->count + 0.5) && seen > 0) {
+            long value = latency_bucket_max(i);
+            *targets[q++] = (value < out->max_us) ? value : out->max_us;
+        }
+    }
+}
+
+void display_stats(shared_data_t* data) {
+    // Snapshot primeiro: a formatação já não bloqueia ninguém
+    server_stats_t stats;
+    stats_snapshot(data, &stats);
     
     // --- CÁLCULOS ---
     time_t now = time(NULL);
-    long uptime = now - data->stats.start_time;
+    long uptime = now - stats.start_time;
     
     double avg_time = 0;
-    if (data->stats.total_requests > 0)
-        avg_time = (double)data->stats.total_response_time_ms / data->stats.total_requests;
+    if (stats.total_requests > 0)
+        avg_time = (double)stats.total_response_time_us / stats.total_requests / 1000.0;
 
     double hit_rate = 0;
-    if (data->stats.total_requests > 0)
-        hit_rate = ((double)data->stats.cache_hits / data->stats.total_requests) * 100.0;
+    if (stats.total_requests > 0)
+        hit_rate = ((double)stats.cache_hits / stats.total_requests) * 100.0;
     // ----------------
 
     printf("\n========================================\n");
     printf("SERVER STATISTICS\n");
     printf("========================================\n");
     printf("Uptime: %ld seconds\n", uptime);
-    printf("Total Requests: %ld\n", data->stats.total_requests);
-    printf("Bytes Transferred: %ld\n", data->stats.bytes_transferred);
-    printf("Status 200: %ld\n", data->stats.status_200);
-    printf("Status 403: %ld\n", data->stats.status_403);
-    printf("Status 404: %ld\n", data->stats.status_404);
-    printf("Status 500: %ld\n", data->stats.status_500);
-    printf("Average Response Time: %.2f ms\n", avg_time);
-    printf("Active Connections: %d\n", data->stats.active_connections);
+    printf("Total Requests: %ld\n", stats.total_requests);
+    printf("Bytes Transferred: %ld\n", stats.bytes_transferred);
+    printf("Status 200: %ld\n", stats.status_200);
+    printf("Status 304: %ld\n", stats.status_304);
+    printf("Status 403: %ld\n", stats.status_403);
+    printf("Status 404: %ld\n", stats.status_404);
+    printf("Status 500: %ld\n", stats.status_500);
+    printf("Average Response Time: %.3f ms\n", avg_time);
+    printf("Active Connections: %d\n", stats.active_connections);
+    printf("Pool Threads: %d\n", stats.pool_threads);
+    printf("Queue Depth: %d\n", stats.queue_depth);
+    printf("Shed (503): %ld\n", stats.requests_shed);
+    printf("Rebalanced Connections: %ld\n", stats.connections_rebalanced);
     printf("Cache Hit Rate: %.1f%%\n", hit_rate);
+    printf("Latency (us)   count      p50      p90      p99    p99.9      max\n");
+    for (int cls = 0; cls < LAT_CLASSES; cls++) {
+        latency_summary_t lat;
+        stats_latency(data, cls, &lat);
+        printf("%-10s %9ld %8ld %8ld %8ld %8ld %8ld\n", stats_latency_class_name(cls),
+               lat.count, lat.p50_us, lat.p90_us, lat.p99_us, lat.p999_us, lat.max_us);
+    }
     printf("========================================\n\n");
-    
-    sem_post(sems->stats_mutex);
-}
\ No newline at end of file
+}
@@ -3,11 +3,36 @@
 #define STATS_H
 
 #include "shared_mem.h"
-#include "semaphores.h"
+#include <time.h>
 
-void update_stats(shared_data_t* data, semaphores_t* sems, 
-                  int status, size_t bytes, long response_time_ms, int is_cache_hit);
+// Chamado uma vez por processo worker (antes de criar threads)
+void stats_init_worker(shared_data_t* data, int worker_id);
 
-void display_stats(shared_data_t* data, semaphores_t* sems);
+// Cada thread que atualiza estatísticas reserva o seu próprio slot
+void stats_bind_thread(void);
+void stats_unbind_thread(void);
 
-#endif
\ No newline at end of file
+// Microssegundos desde 'start' (CLOCK_MONOTONIC)
+long stats_elapsed_us(const struct timespec* start);
+
+// Escrita sem locks no slot da thread atual + histograma da classe
+void update_stats(int status, size_t bytes, long response_time_us, latency_class_t cls);
+void stats_connection_opened(void);
+void stats_connection_closed(int count);
+
+// Fila de admissão: profundidade atual deste worker e conexões recusadas
+void stats_queue_depth(int depth);
+void stats_request_shed(void);
+void stats_pool_threads(int threads);
+void stats_connection_rebalanced(void);
+
+// Soma consistente de todos os slots (seqlock)
+void stats_snapshot(shared_data_t* data, server_stats_t* out);
+
+// Percentis p50/p90/p99/p99.9/max de uma classe (todos os workers)
+void stats_latency(shared_data_t* data, latency_class_t cls, latency_summary_t* out);
+const char* stats_latency_class_name(latency_class_t cls);
+
+void display_stats(shared_data_t* data);
+
+#endif
@@ -3,9 +3,13 @@
 #include "thread_pool.h"
 #include "http.h"
 #include "cache.h"
+#include "file_cache.h"
 #include "stats.h"
 #include "logger.h"
+#include "journal.h"
 #include "cgi.h"
+#include "gzip.h"
+#include "rebalance.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -18,317 +22,799 @@
 #include <errno.h>
 #include <time.h>
 
-#define KEEPALIVE_TIMEOUT 5 // segundos
-
-const char* get_mime_type(const char* filename) {
-    const char* dot = strrchr(filename, '.');
-    if (!dot) return "application/octet-stream";
-    if (strcmp(dot, ".html") == 0) return "text/html";
-    if (strcmp(dot, ".css") == 0) return "text/css";
-    if (strcmp(dot, ".js") == 0) return "application/javascript";
-    if (strcmp(dot, ".png") == 0) return "image/png";
-    if (strcmp(dot, ".jpg") == 0) return "image/jpeg";
-    if (strcmp(dot, ".gif") == 0) return "image/gif";
-    if (strcmp(dot, ".pdf") == 0) return "application/pdf";
-    return "text/plain";
-}
-
 // Helper para páginas de erro
 void send_error_page_file(int fd, int status, const char* status_msg, const char* file_path, 
                           shared_data_t* shm, semaphores_t* sems, const char* req_path) {
     (void)shm; (void)sems; (void)req_path; // unused warning fix
     
     FILE* file = fopen(file_path, "rb");
-    size_t bytes_sent = 0;
-    
-    if (!file) {
+    int sent = 0;
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        long fsize = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        char* body = (fsize >= 0) ? malloc(fsize + 1) : NULL;
+        if (body) {
+            size_t read_bytes = fread(body, 1, fsize, file);
+            send_http_response(fd, status, status_msg, "text/html", body, read_bytes, 0);
+            free(body);
+            sent = 1;
+        }
+        fclose(file);
+    }
+
+    // Sem página (ou sem memória para ela): o status segue na mesma
+    if (!sent) {
         const char* fallback_body = (status == 404) ? "404 Not Found" : "500 Internal Error";
-        bytes_sent = strlen(fallback_body);
-        send_http_response(fd, status, status_msg, "text/plain", fallback_body, bytes_sent, 0);
-        return; 
+        send_http_response(fd, status, status_msg, "text/plain", fallback_body, strlen(fallback_body), 0);
     }
+}
 
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    fseek(file, 0, SEEK_SET);
+// Ficheiros abaixo deste tamanho são lidos para memória e guardados em cache
+#define CACHE_MAX_FILE_SIZE 1048576
 
-    char* body = malloc(fsize);
-    if (body) {
-        size_t read_bytes = fread(body, 1, fsize, file);
-        send_http_response(fd, status, status_msg, "text/html", body, read_bytes, 0);
-        free(body);
-    }
-    fclose(file);
+// Linhas ETag + Last-Modified (+ Vary e Content-Encoding) para respostas 200 de ficheiros estáticos
+static void format_validators(const cache_meta_t* meta, char* buf, size_t size) {
+    snprintf(buf, size, "ETag: %s\r\nLast-Modified: %s\r\n%s%s", meta->etag, meta->last_modified,
+             http_compressible(meta->mime) ? "Vary: Accept-Encoding\r\n" : "",
+             meta->gzip ? "Content-Encoding: gzip\r\n" : "");
 }
 
-void handle_client(thread_pool_t* pool, int client_fd) {
-    setbuf(stdout, NULL);
-    
-    shared_data_t* shm = pool->shm;
-    semaphores_t* sems = pool->sems;
+static size_t ranges_bytes(const http_range_t* ranges, int count) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += ranges[i].end - ranges[i].start + 1;
+    return total;
+}
 
-    // 1. Configurar Timeout no Socket (Keep-Alive)
-    struct timeval tv;
-    tv.tv_sec = KEEPALIVE_TIMEOUT;
-    tv.tv_usec = 0;
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+// Corpo completo (200) ou os intervalos pedidos (206) a partir de memória
+static void send_body(int client_fd, const cache_meta_t* meta, const char* body, size_t size,
+                      const http_range_t* ranges, int nranges, int is_head, int* status, size_t* bytes_sent) {
+    char validators[256];
+    format_validators(meta, validators, sizeof(validators));
+    if (nranges > 0) {
+        send_http_ranges(client_fd, meta->mime, validators, body, -1, ranges, nranges, size, 1);
+        *bytes_sent = ranges_bytes(ranges, nranges); *status = 206;
+    } else {
+        send_http_response_ex(client_fd, 200, "OK", meta->mime, validators,
+                              (is_head ? NULL : body), size, 1);
+        *bytes_sent = size; *status = 200;
+    }
+}
 
-    // Incrementar Active Connections (uma vez por cliente)
-    sem_wait(sems->stats_mutex);
-    shm->stats.active_connections++;
-    sem_post(sems->stats_mutex);
+// Responde com uma entrada da cache de conteúdo (304, 416, 206 ou 200) e liberta-a
+static void send_cached(thread_pool_t* pool, int client_fd, const http_request_t* req, const void* data,
+                        size_t size, int is_head, int* status, size_t* bytes_sent) {
+    const cache_meta_t* meta = cache_get_meta(pool->cache, data);
+    http_range_t ranges[HTTP_MAX_RANGES];
+    int nranges;
+
+    if (http_not_modified(req, meta->etag, meta->last_modified)) {
+        // O cliente já tem esta versão: os validadores vêm da cache, sem disco
+        send_http_not_modified(client_fd, meta->etag, meta->last_modified, http_compressible(meta->mime), 1);
+        *status = 304;
+    } else if ((nranges = http_parse_ranges(req, size, meta->etag, meta->last_modified,
+                                            ranges, HTTP_MAX_RANGES)) == 0) {
+        send_http_range_not_satisfiable(client_fd, size, 1);
+        *status = 416;
+    } else {
+        // Intervalos servidos diretamente do corpo em cache
+        send_body(client_fd, meta, data, size, ranges, nranges, is_head, status, bytes_sent);
+    }
+    cache_release(pool->cache, data); // Só agora a entrada pode ser libertada
+}
 
-    // Loop para processar múltiplos pedidos na mesma conexão
-    while (1) {
-        char buffer[8192];
-        
-        struct timeval start, end;
-        gettimeofday(&start, NULL);
+// Resposta completa (304, 416, 206 ou 200) a partir da cache de ficheiros abertos.
+// Ficheiros pequenos ficam na cache de conteúdo com a chave 'cache_key'.
+static void send_file_entry(thread_pool_t* pool, int client_fd, const http_request_t* req, file_entry_t* fe,
+                            const char* cache_key, int is_head, int* status, size_t* bytes_sent) {
+    long fsize = fe->size;
+
+    // Pedido condicional: 304 antes de qualquer leitura
+    if (http_not_modified(req, fe->meta.etag, fe->meta.last_modified)) {
+        send_http_not_modified(client_fd, fe->meta.etag, fe->meta.last_modified, http_compressible(fe->meta.mime), 1);
+        *status = 304;
+        return;
+    }
 
-        ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes_read <= 0) break; // Cliente fechou ou timeout
-        
-        buffer[bytes_read] = '\0';
-        
-        // Reset request structure
-        http_request_t req;
-        memset(&req, 0, sizeof(req)); 
-        // --------------------------------------------
+    http_range_t ranges[HTTP_MAX_RANGES];
+    int nranges = http_parse_ranges(req, fsize, fe->meta.etag, fe->meta.last_modified, ranges, HTTP_MAX_RANGES);
+    if (nranges == 0) {
+        send_http_range_not_satisfiable(client_fd, fsize, 1);
+        *status = 416;
+        return;
+    }
 
-        int status = 500;
-        size_t bytes_sent = 0;
-        char req_path[512] = "";
-        int is_cache_hit = 0;
+    // Ficheiro pequeno: ler para memória para o guardar em cache (os próximos
+    // Range ao mesmo ficheiro já saem da cache). Sem memória, segue por sendfile.
+    char* b = (!is_head && pool->cache && fsize < CACHE_MAX_FILE_SIZE) ? malloc(fsize) : NULL;
+    if (b) {
+        ssize_t got = 0, n = 0;
+        while (got < fsize && (n = pread(fe->fd, b + got, fsize - got, got)) > 0) got += n;
+        if (got == fsize) {
+            send_body(client_fd, &fe->meta, b, fsize, ranges, nranges, 0, status, bytes_sent);
+            cache_put(pool->cache, cache_key, b, fsize, &fe->meta);
+        } else {
+            // Leitura curta (o ficheiro encolheu entretanto) ou erro: o tamanho e
+            // os intervalos já não batem certo com o conteúdo, e o sendfile do
+            // mesmo fd também falharia. Nunca um 200/206 truncado.
+            const char* msg = "500 Internal Error";
+            send_http_response(client_fd, 500, "Internal Server Error", "text/plain", msg, strlen(msg), 1);
+            *bytes_sent = strlen(msg); *status = 500;
+        }
+        free(b);
+    } else if (is_head) {
+        send_http_prebuilt_file_response(client_fd, fe->header, fe->header_len, -1, fsize, 1);
+        *bytes_sent = fsize; *status = 200;
+    } else if (nranges > 0) {
+        // Intervalos de um ficheiro grande: sendfile em cada offset, sem buffer
+        char validators[256];
+        format_validators(&fe->meta, validators, sizeof(validators));
+        send_http_ranges(client_fd, fe->meta.mime, validators, NULL, fe->fd, ranges, nranges, fsize, 1);
+        *bytes_sent = ranges_bytes(ranges, nranges); *status = 206;
+    } else {
+        // Ficheiro grande: zero-copy do disco para o socket
+        send_http_prebuilt_file_response(client_fd, fe->header, fe->header_len, fe->fd, fsize, 1);
+        *bytes_sent = fsize; *status = 200;
+    }
+}
 
-        if (parse_http_request(buffer, &req) != 0) {
-            send_http_response(client_fd, 400, "Bad Request", "text/html", NULL, 0, 0);
-            break; // Sai do loop imediatamente
+// Variante gzip de um ficheiro de texto, por ordem:
+// 1. já comprimida na cache de conteúdo (chave "gzip:<path>")
+// 2. ficheiro "<path>.gz" pré-comprimido ao lado do original
+// 3. comprimir o original uma vez e guardar o resultado na cache
+// Devolve 0 se não há variante (o pedido segue sem compressão).
+static int serve_gzip(thread_pool_t* pool, int client_fd, const http_request_t* req, const char* file_path,
+                      int is_head, int* status, size_t* bytes_sent, latency_class_t* lat_class) {
+    char key[1100];
+    snprintf(key, sizeof(key), "gzip:%s", file_path);
+
+    // 1. Cache de conteúdo
+    if (pool->cache) {
+        size_t c_size = 0;
+        const void* c_data = cache_get(pool->cache, key, &c_size);
+        if (c_data) {
+            *lat_class = LAT_CACHE_HIT;
+            send_cached(pool, client_fd, req, c_data, c_size, is_head, status, bytes_sent);
+            return 1;
         }
-        
-        // KEEP-ALIVE INTELIGENTE -----------------------------
-        // Assume FECHAR por defeito (para o 'ab' não bloquear)
-        int keep_alive = 0; 
-        
-        // Só mantém aberto se for explicitamente HTTP/1.1
-        if (strcasecmp(req.version, "HTTP/1.1") == 0) {
-            keep_alive = 1;
+    }
+
+    // 2. Sidecar .gz (o header pronto já leva Content-Encoding e Vary)
+    file_entry_t* fe = file_cache_open_gzip(pool->files, file_path);
+    if (fe) {
+        send_file_entry(pool, client_fd, req, fe, key, is_head, status, bytes_sent);
+        file_cache_release(pool->files, fe);
+        return 1;
+    }
+
+    // 3. Comprimir uma vez (só ficheiros que cabem na cache)
+    if (!pool->cache) return 0;
+    fe = file_cache_open(pool->files, file_path);
+    if (!fe) return 0;
+    if (fe->size < pool->config->gzip_min_length || fe->size >= CACHE_MAX_FILE_SIZE) {
+        file_cache_release(pool->files, fe);
+        return 0;
+    }
+
+    // ETag própria: as duas representações não podem partilhar o validador forte
+    cache_meta_t meta = fe->meta;
+    size_t etag_len = strlen(meta.etag);
+    if (etag_len > 1 && etag_len + 3 < sizeof(meta.etag)) {
+        memcpy(meta.etag + etag_len - 1, "-gz\"", 5);
+    }
+    meta.gzip = 1;
+
+    int served = 1;
+    if (http_not_modified(req, meta.etag, meta.last_modified)) {
+        send_http_not_modified(client_fd, meta.etag, meta.last_modified, 1, 1);
+        *status = 304;
+    } else {
+        long fsize = fe->size;
+        char* raw = malloc(fsize);
+        ssize_t got = 0, n;
+        while (raw && got < fsize && (n = pread(fe->fd, raw + got, fsize - got, got)) > 0) got += n;
+
+        size_t gz_len = 0;
+        void* gz = (raw && got == fsize) ? gzip_compress(raw, fsize, &gz_len) : NULL;
+        free(raw);
+        if (gz) {
+            char validators[256];
+            format_validators(&meta, validators, sizeof(validators));
+            send_http_response_ex(client_fd, 200, "OK", meta.mime, validators,
+                                  (is_head ? NULL : gz), gz_len, 1);
+            cache_put(pool->cache, key, gz, gz_len, &meta);
+            free(gz);
+            *bytes_sent = gz_len; *status = 200;
+        } else {
+            served = 0; // Não comprimiu (ou não ganha nada): vai sem compressão
         }
-        
-        // Se o cliente pediu para fechar, respeitamos sempre
-        if (req.connection_close) {
-            keep_alive = 0;
+    }
+    file_cache_release(pool->files, fe);
+    return served;
+}
+
+// --- Micro-cache CGI ---
+
+// TTL configurado para a rota (CGI_CACHE_<path>), 0 = sem cache
+static int cgi_cache_ttl(const server_config_t* config, const char* path, int path_len) {
+    for (int i = 0; i < config->cgi_cache_count; i++) {
+        if ((int)strlen(config->cgi_cache[i].path) == path_len &&
+            memcmp(config->cgi_cache[i].path, path, path_len) == 0) {
+            return config->cgi_cache[i].ttl;
         }
-        // --------------------------------------------------
-
-        strcpy(req_path, req.path);
-
-        // DASHBOARD ------------------------------------------------------------------------
-        if (strcmp(req.path, "/stats") == 0) {
-            sem_wait(sems->stats_mutex);
-            time_t now = time(NULL);
-            long uptime = now - shm->stats.start_time;
-            double avg_time = (shm->stats.total_requests > 0) ? 
-                (double)shm->stats.total_response_time_ms / shm->stats.total_requests : 0;
-
-            char body[8192];
-            int body_len = snprintf(body, sizeof(body),
-                "<!DOCTYPE html><html><head><meta http-equiv='refresh' content='3'><title>Stats</title>"
-                "<style>body{font-family:sans-serif;padding:20px;background:#f4f4f9} .card{background:#fff;padding:20px;border-radius:8px;box-shadow:0 2px 5px rgba(0,0,0,0.1)}</style>"
-                "</head><body><div class='card'><h1>Server Dashboard</h1>"
-                "<p>Uptime: <b>%lds</b> | Active Conn: <b>%d</b></p>"
-                "<p>Total Req: <b>%ld</b> | Avg Time: <b>%.2fms</b></p>"
-                "<p>Bytes: <b>%ld</b> | Hits: <b>%ld</b></p>"
-                "<p>200: %ld | 404: %ld | 500: %ld</p></div></body></html>",
-                uptime, shm->stats.active_connections, shm->stats.total_requests, avg_time,
-                shm->stats.bytes_transferred, shm->stats.cache_hits,
-                shm->stats.status_200, shm->stats.status_404, shm->stats.status_500
-            );
-            sem_post(sems->stats_mutex);
-            
-            send_http_response(client_fd, 200, "OK", "text/html", body, body_len, 1);
-            status = 200; bytes_sent = body_len;
+    }
+    return 0;
+}
+
+// Agenda o refresh de 'key' para uma thread livre. Um só refresh por chave:
+// enquanto ele não acaba, os pedidos seguintes continuam a servir a cópia antiga
+static void refresh_schedule(thread_pool_t* pool, const char* key, const char* file_path, const char* query,
+                             const http_request_t* req, int ttl) {
+    pthread_mutex_lock(&pool->mutex);
+    int busy = pool->shutdown || pool->refresh_count >= CGI_REFRESH_SLOTS;
+    for (cgi_refresh_t* r = pool->refreshes; r && !busy; r = r->next) busy = strcmp(r->key, key) == 0;
+    cgi_refresh_t* task = busy ? NULL : malloc(sizeof(cgi_refresh_t));
+    if (task) {
+        task->running = 0;
+        task->ttl = ttl;
+        snprintf(task->key, sizeof(task->key), "%s", key);
+        snprintf(task->file_path, sizeof(task->file_path), "%s", file_path);
+        snprintf(task->query, sizeof(task->query), "%s", query);
+        snprintf(task->version, sizeof(task->version), "%.*s", (int)req->version.len, req->version.ptr);
+        task->next = pool->refreshes;
+        pool->refreshes = task;
+        pool->refresh_count++;
+        pool->refresh_queued++;
+        pthread_cond_signal(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Guarda a resposta capturada (se for cacheável) com validade de 'ttl' segundos
+static void cgi_cache_store(thread_pool_t* pool, const char* key, cgi_capture_t* cap, int ttl) {
+    if (!cap->cacheable) return;
+    cache_meta_t meta;
+    memset(&meta, 0, sizeof(meta));
+    snprintf(meta.mime, sizeof(meta.mime), "%s", cap->content_type);
+    meta.expires = time(NULL) + ttl;
+    cache_put(pool->cache, key, cap->data ? cap->data : "", cap->len, &meta);
+}
+
+// Cópia fresca (HIT) ou, até CGI_CACHE_STALE segundos depois do TTL, a cópia
+// antiga (STALE, com '*stale' a 1: o caller agenda o refresh). Devolve 0 se
+// não há cópia utilizável.
+static int serve_cgi_cached(thread_pool_t* pool, int client_fd, const char* key, int is_head,
+                            int keep_alive, size_t* bytes_sent, int* stale_out) {
+    size_t size = 0;
+    const void* data = cache_get(pool->cache, key, &size);
+    if (!data) return 0;
+
+    const cache_meta_t* meta = cache_get_meta(pool->cache, data);
+    time_t now = time(NULL);
+    int stale = now >= meta->expires;
+    if (stale && now >= meta->expires + pool->config->cgi_cache_stale) {
+        cache_release(pool->cache, data); // Demasiado antiga: correr o script
+        return 0;
+    }
+
+    *stale_out = stale;
+    send_http_response_ex(client_fd, 200, "OK", meta->mime, stale ? "X-Cache: STALE\r\n" : "X-Cache: HIT\r\n",
+                          (is_head ? NULL : data), size, keep_alive);
+    *bytes_sent = is_head ? 0 : size;
+    cache_release(pool->cache, data);
+    return 1;
+}
+
+// Processa um único pedido já analisado (as vistas apontam para o buffer da conexão).
+// Devolve 1 se a conexão deve continuar aberta (keep-alive) ou 0 para fechar.
+static int process_request(thread_pool_t* pool, int client_fd, const http_request_t* req, const struct timespec* start) {
+    shared_data_t* shm = pool->shm;
+    semaphores_t* sems = pool->sems;
+
+    int status = 500;
+    size_t bytes_sent = 0;
+    latency_class_t lat_class = LAT_CACHE_MISS;
+    int is_head = http_str_eq(req->method, "HEAD");
+
+    // Cópias terminadas em '\0' só para o log, o journal e as páginas de erro
+    char method[HTTP_MAX_METHOD + 1];
+    char req_path[HTTP_MAX_PATH + 1];
+    memcpy(method, req->method.ptr, req->method.len);
+    method[req->method.len] = '\0';
+    memcpy(req_path, req->path.ptr, req->path.len);
+    req_path[req->path.len] = '\0';
+
+    // KEEP-ALIVE INTELIGENTE -----------------------------
+    // Assume FECHAR por defeito (para o 'ab' não bloquear)
+    int keep_alive = 0; 
+    
+    // Só mantém aberto se for explicitamente HTTP/1.1
+    if (http_str_case_eq(req->version, "HTTP/1.1")) {
+        keep_alive = 1;
+    }
+    
+    // Se o cliente pediu para fechar, respeitamos sempre
+    if (req->connection_close) {
+        keep_alive = 0;
+    }
+    // --------------------------------------------------
+
+    // DASHBOARD ------------------------------------------------------------------------
+    if (http_str_eq(req->path, "/stats")) {
+        // Snapshot sem locks (seqlock por slot) antes de formatar o HTML
+        server_stats_t stats;
+        stats_snapshot(shm, &stats);
+
+        time_t now = time(NULL);
+        long uptime = now - stats.start_time;
+        double avg_time = (stats.total_requests > 0) ? 
+            (double)stats.total_response_time_us / stats.total_requests / 1000.0 : 0;
+
+        // Tabela de percentis por classe (histogramas em SHM)
+        char lat_rows[1024];
+        int rows_len = 0;
+        for (int cls = 0; cls < LAT_CLASSES; cls++) {
+            latency_summary_t lat;
+            stats_latency(shm, cls, &lat);
+            rows_len += snprintf(lat_rows + rows_len, sizeof(lat_rows) - rows_len,
+                "<tr><td>%s</td><td>%ld</td><td>%ld</td><td>%ld</td><td>%ld</td><td>%ld</td><td>%ld</td></tr>",
+                stats_latency_class_name(cls), lat.count,
+                lat.p50_us, lat.p90_us, lat.p99_us, lat.p999_us, lat.max_us);
         }
-        // SERVIR FICHEIRO / CGI ---------------------------------------------------
-        else {
-            char file_path[1024];
-            
-            // LÓGICA VIRTUAL HOSTS ------------------------------------------------
-            const char* base_root = pool->config->document_root; // Root padrão
-
-            // Procurar se o host corresponde a algum VHost configurado
-            for (int i = 0; i < pool->config->vhost_count; i++) {
-                if (strcmp(req.host, pool->config->vhosts[i].hostname) == 0) {
-                    base_root = pool->config->vhosts[i].root;
-                    break;
-                }
+
+        char body[8192];
+        int body_len = snprintf(body, sizeof(body),
+            "<!DOCTYPE html><html><head><meta http-equiv='refresh' content='3'><title>Stats</title>"
+            "<style>body{font-family:sans-serif;padding:20px;background:#f4f4f9} .card{background:#fff;padding:20px;border-radius:8px;box-shadow:0 2px 5px rgba(0,0,0,0.1)}</style>"
+            "</head><body><div class='card'><h1>Server Dashboard</h1>"
+            "<p>Uptime: <b>%lds</b> | Active Conn: <b>%d</b> | Threads: <b>%d</b> | Queue: <b>%d</b> | Shed (503): <b>%ld</b> | Rebalanced: <b>%ld</b></p>"
+            "<p>Total Req: <b>%ld</b> | Avg Time: <b>%.3fms</b></p>"
+            "<p>Bytes: <b>%ld</b> | Hits: <b>%ld</b></p>"
+            "<p>200: %ld | 304: %ld | 404: %ld | 500: %ld</p>"
+            "<h2>Latency (&micro;s)</h2><table cellpadding='4'>"
+            "<tr><th>Class</th><th>Count</th><th>p50</th><th>p90</th><th>p99</th><th>p99.9</th><th>Max</th></tr>"
+            "%s</table></div></body></html>",
+            uptime, stats.active_connections, stats.pool_threads, stats.queue_depth, stats.requests_shed,
+            stats.connections_rebalanced, stats.total_requests, avg_time,
+            stats.bytes_transferred, stats.cache_hits,
+            stats.status_200, stats.status_304, stats.status_404, stats.status_500, lat_rows
+        );
+        
+        send_http_response(client_fd, 200, "OK", "text/html", body, body_len, 1);
+        status = 200; bytes_sent = body_len;
+    }
+    // SERVIR FICHEIRO / CGI ---------------------------------------------------
+    else {
+        char file_path[1024];
+        
+        // LÓGICA VIRTUAL HOSTS ------------------------------------------------
+        const char* base_root = pool->config->document_root; // Root padrão
+
+        // Procurar se o host corresponde a algum VHost configurado
+        for (int i = 0; i < pool->config->vhost_count; i++) {
+            if (http_str_eq(req->host, pool->config->vhosts[i].hostname)) {
+                base_root = pool->config->vhosts[i].root;
+                break;
             }
+        }
 
-            if (strcmp(req.path, "/") == 0) 
-                snprintf(file_path, sizeof(file_path), "%s/index.html", base_root);
-            else 
-                snprintf(file_path, sizeof(file_path), "%s%s", base_root, req.path);
-            // ---------------------------
-
-            // BÓNUS CGI: Detetar scripts Python ----------------------------------
-            char* ext = strrchr(file_path, '.');
-            if (ext && strcmp(ext, ".py") == 0) {
-                // É um script Python! Executar CGI
-                int cgi_status = handle_cgi_request(client_fd, file_path);
-                
-                if (cgi_status == 500) {
-                    send_error_page_file(client_fd, 500, "Internal Server Error", 
-                                       "www/errors/500.html", shm, sems, req_path);
+        // Path sem a query string ("/a.py?x=1" -> "/a.py" + QUERY_STRING "x=1")
+        const char* query = strchr(req_path, '?');
+        int path_len = query ? (int)(query - req_path) : (int)strlen(req_path);
+        query = query ? query + 1 : "";
+
+        if (path_len == 1 && req_path[0] == '/') 
+            snprintf(file_path, sizeof(file_path), "%s/index.html", base_root);
+        else 
+            snprintf(file_path, sizeof(file_path), "%s%.*s", base_root, path_len, req_path);
+        // ---------------------------
+
+        // BÓNUS CGI: Detetar scripts Python ----------------------------------
+        char* ext = strrchr(file_path, '.');
+        if (ext && strcmp(ext, ".py") == 0) {
+            // É um script Python! Executar CGI
+            size_t cgi_bytes = 0;
+            int cgi_status;
+            latency_class_t cgi_class = LAT_CGI;
+
+            // Micro-cache (opt-in por rota): chave vhost + path + query. Só GET e
+            // HEAD a consultam e só um GET com 200 a preenche; POST e os outros
+            // métodos correm sempre o script
+            int is_get = http_str_eq(req->method, "GET");
+            int ttl = (pool->cache && (is_get || is_head)) ? cgi_cache_ttl(pool->config, req_path, path_len) : 0;
+            char cgi_key[HTTP_MAX_PATH + 160];
+            snprintf(cgi_key, sizeof(cgi_key), "cgi:%.*s%s", (int)req->host.len, req->host.ptr, req_path);
+            int stale = 0;
+
+            if (ttl > 0 && serve_cgi_cached(pool, client_fd, cgi_key, is_head, keep_alive, &cgi_bytes, &stale)) {
+                cgi_status = 200;
+                cgi_class = LAT_CACHE_HIT;
+                // Cópia expirada servida: a nova é gerada por outra thread
+                if (stale) refresh_schedule(pool, cgi_key, file_path, query, req, ttl);
+            } else {
+                // O output segue para o cliente à medida que o script o produz
+                // (e é copiado para a micro-cache se a rota tiver TTL)
+                cgi_capture_t capture;
+                int store = ttl > 0 && is_get;
+                cgi_status = handle_cgi_request(client_fd, file_path, query, req, &keep_alive, &cgi_bytes,
+                                                store ? &capture : NULL);
+                if (store) {
+                    if (cgi_status == 200) cgi_cache_store(pool, cgi_key, &capture, ttl);
+                    cgi_capture_free(&capture);
                 }
-                
-                // Registar stats e sair deste pedido
-                gettimeofday(&end, NULL);
-                long dur = ((end.tv_sec - start.tv_sec)*1000000 + end.tv_usec - start.tv_usec) / 1000;
-                log_request(sems->log_mutex, "127.0.0.1", req.method, req_path, cgi_status, 0);
-                update_stats(shm, sems, cgi_status, 0, dur, 0);
-                
-                if (!keep_alive) break;
-                continue; // Salta para o próximo pedido do loop
             }
-            // -----------------------------------------
-
-            // Cache
-            size_t c_size = 0;
-            // Só usa a cache se NÃO for um pedido de Range (req.range_start == -1)
-            void* c_data = (pool->cache && req.range_start == -1) ? cache_get(pool->cache, file_path, &c_size) : NULL;
-
-            if (c_data) {
-                is_cache_hit = 1; bytes_sent = c_size; status = 200;
-                send_http_response(client_fd, 200, "OK", get_mime_type(file_path), 
-                                 (strcmp(req.method, "HEAD")==0 ? NULL : c_data), bytes_sent, 1);
-                free(c_data);
+            
+            if (cgi_status < 0) {
+                cgi_status = 500;
+                send_error_page_file(client_fd, 500, "Internal Server Error", 
+                                   "www/errors/500.html", shm, sems, req_path);
+                keep_alive = 0; // A página de erro fecha a conexão
+            }
+            
+            // Registar stats e sair deste pedido
+            long dur = stats_elapsed_us(start);
+            log_request("127.0.0.1", method, req_path, cgi_status, cgi_bytes);
+            update_stats(cgi_status, cgi_bytes, dur, cgi_class);
+            journal_record(cgi_status, cgi_bytes, dur, cgi_status >= 400 ? LAT_ERROR : cgi_class, req_path);
+            
+            return keep_alive; // Pedido seguinte chega pelo event loop
+        }
+        // -----------------------------------------
+
+        // Compressão: só pedidos completos de tipos de texto
+        int gzip_served = pool->config->gzip && req->accept_gzip && req->range.len == 0 &&
+                          http_compressible(get_mime_type(file_path)) &&
+                          serve_gzip(pool, client_fd, req, file_path, is_head, &status, &bytes_sent, &lat_class);
+
+        // Cache (também para Range: os intervalos saem do corpo em memória)
+        size_t c_size = 0;
+        const void* c_data = (!gzip_served && pool->cache) ? cache_get(pool->cache, file_path, &c_size) : NULL;
+
+        if (gzip_served) {
+            // Variante comprimida já enviada
+        } else if (c_data) {
+            lat_class = LAT_CACHE_HIT;
+            send_cached(pool, client_fd, req, c_data, c_size, is_head, &status, &bytes_sent);
+        } else {
+            // fd, tamanho, MIME e header já preparados em pedidos anteriores
+            file_entry_t* fe = file_cache_open(pool->files, file_path);
+
+            if (fe) {
+                // 304, Range (206/416) ou pedido normal (200)
+                send_file_entry(pool, client_fd, req, fe, file_path, is_head, &status, &bytes_sent);
+                file_cache_release(pool->files, fe); // O fd fica aberto na cache
             } else {
-                FILE* f = fopen(file_path, "rb");
-                if (f) {
-                    fseek(f, 0, SEEK_END);
-                    long fsize = ftell(f);
-                    
-                    // --- BÓNUS: Lógica de Range Requests ---
-                    if (req.range_start != -1 && req.range_start < fsize) {
-                        // É um pedido parcial!
-                        long start = req.range_start;
-                        long end = (req.range_end == -1 || req.range_end >= fsize) ? fsize - 1 : req.range_end;
-                        size_t chunk_size = end - start + 1;
-
-                        char* b = malloc(chunk_size);
-                        if (b) {
-                            fseek(f, start, SEEK_SET); // Saltar para o início pedido
-                            fread(b, 1, chunk_size, f);
-                            
-                            // Enviar 206 Partial Content
-                            send_http_partial_response(client_fd, get_mime_type(file_path), b, chunk_size, start, end, fsize, 1);
-                            free(b);
-                        }
-                        bytes_sent = chunk_size; status = 206;
-                    } 
-                    else {
-                        // Pedido Normal (200 OK)
-                        fseek(f, 0, SEEK_SET);
-                        if (strcmp(req.method, "HEAD") == 0) {
-                            send_http_response(client_fd, 200, "OK", get_mime_type(file_path), NULL, fsize, 1);
-                        } else {
-                            char* b = malloc(fsize);
-                            if (b) {
-                                fread(b, 1, fsize, f);
-                                send_http_response(client_fd, 200, "OK", get_mime_type(file_path), b, fsize, 1);
-                                // Guardar em cache aqui (apenas se for pedido normal)
-                                if (pool->cache && fsize < 1048576) cache_put(pool->cache, file_path, b, fsize);
-                                free(b);
-                            }
-                        }
-                        bytes_sent = fsize; status = 200;
-                    }
-                    fclose(f);
-                } else {
-                    status = (errno == EACCES) ? 403 : 404;
-                    send_error_page_file(client_fd, status, (status==403?"Forbidden":"Not Found"), 
-                                       (status==403?"www/errors/403.html":"www/errors/404.html"), 
-                                       shm, sems, req_path);
-                    keep_alive = 0; // Erros fecham conexão
-                }
+                status = (errno == EACCES) ? 403 : 404;
+                send_error_page_file(client_fd, status, (status==403?"Forbidden":"Not Found"), 
+                                   (status==403?"www/errors/403.html":"www/errors/404.html"), 
+                                   shm, sems, req_path);
+                keep_alive = 0; // Erros fecham conexão
             }
         }
+    }
+
+    // Stats Update
+    long dur = stats_elapsed_us(start);
+    if (req_path[0]) {
+        log_request("127.0.0.1", method, req_path, status, bytes_sent);
+        update_stats(status, bytes_sent, dur, lat_class);
+        journal_record(status, bytes_sent, dur, status >= 400 ? LAT_ERROR : lat_class, req_path);
+    }
+
+    return keep_alive;
+}
 
-        // Stats Update
-        gettimeofday(&end, NULL);
-        long dur = ((end.tv_sec - start.tv_sec)*1000000 + end.tv_usec - start.tv_usec) / 1000;
-        if (req_path[0]) {
-            log_request(sems->log_mutex, "127.0.0.1", req.method, req_path, status, bytes_sent);
-            update_stats(shm, sems, status, bytes_sent, dur, is_cache_hit);
+// Guarda os bytes por servir na conexão (pedido parcial ou resto do pipeline).
+// Devolve -1 se não houver memória.
+static int keep_pending(connection_t* conn, const char* data, size_t len, size_t scanned) {
+    if (len == 0) {
+        free(conn->buf); // Conexão inativa volta a custar só a estrutura
+        conn->buf = NULL;
+    } else {
+        if (!conn->buf && !(conn->buf = malloc(CONN_BUFFER_SIZE))) return -1;
+        memmove(conn->buf, data, len);
+    }
+    conn->buf_len = len;
+    conn->scanned = scanned;
+    return 0;
+}
+
+// Chamado quando o event loop deteta dados na conexão: serve todos os
+// pedidos completos que já chegaram (por ordem) e devolve a conexão ao
+// epoll (keep-alive) ou fecha-a. Um pedido incompleto fica no buffer da conexão.
+void handle_client(thread_pool_t* pool, connection_t* conn) {
+    setbuf(stdout, NULL);
+
+    // 1. Continuar sobre os dados pendentes ou usar um buffer na stack
+    char stack_buf[CONN_BUFFER_SIZE];
+    char* buffer = conn->buf ? conn->buf : stack_buf;
+    size_t len = conn->buf_len;
+    size_t scanned = conn->scanned;
+
+    ssize_t bytes_read = recv(conn->fd, buffer + len, CONN_BUFFER_SIZE - len, MSG_DONTWAIT);
+    if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // Acordou sem dados (falso positivo): voltar a esperar
+        event_loop_rearm(pool->loop, conn);
+        return;
+    }
+    if (bytes_read <= 0) { // Cliente fechou ou erro
+        event_loop_close(pool->loop, conn);
+        return;
+    }
+    len += bytes_read;
+
+    // 2. Servir os pedidos completos (pipelining)
+    size_t offset = 0;
+    while (offset < len) {
+        // Relógio monotónico: não salta com ajustes de NTP
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        http_request_t req;
+        long consumed = parse_http_request(buffer + offset, len - offset, &scanned, &req);
+        if (consumed < 0) {
+            int code = req.reject_status;
+            send_http_response(conn->fd, code,
+                               code == 501 ? "Not Implemented" : code == 413 ? "Content Too Large" : "Bad Request",
+                               "text/html", NULL, 0, 0);
+            event_loop_close(pool->loop, conn);
+            return; // Fecha a conexão imediatamente
         }
+        if (consumed == 0) break; // Falta o resto do pedido
 
-        if (!keep_alive) break;
+        if (!process_request(pool, conn->fd, &req, &start)) {
+            event_loop_close(pool->loop, conn);
+            return;
+        }
+        offset += consumed;
     }
 
-    // Decrementar Active Connections ao sair
-    sem_wait(sems->stats_mutex);
-    shm->stats.active_connections--;
-    sem_post(sems->stats_mutex);
+    // 3. Um pedido que não cabe no buffer nunca vai ficar completo. Se os
+    // headers já chegaram (o parser parou antes do fim), é o corpo que não cabe
+    if (offset == 0 && len == CONN_BUFFER_SIZE) {
+        if (scanned < len) {
+            send_http_response(conn->fd, 413, "Content Too Large", "text/html", NULL, 0, 0);
+        } else {
+            send_http_response(conn->fd, 431, "Request Header Fields Too Large", "text/html", NULL, 0, 0);
+        }
+        event_loop_close(pool->loop, conn);
+        return;
+    }
 
-    close(client_fd);
+    if (keep_pending(conn, buffer + offset, len - offset, scanned) != 0) {
+        event_loop_close(pool->loop, conn);
+        return;
+    }
+    event_loop_rearm(pool->loop, conn);
+}
+
+
+
+// Publica a fila e a carga (fila + em curso) deste worker; chamar com o mutex
+static void publish_load(thread_pool_t* pool) {
+    stats_queue_depth(pool->queue_count);
+    rebalance_publish_load(pool->queue_count + pool->busy);
+}
+
+void* worker_thread(void* arg);
+
+// Thread nova (detached); 'num_threads' já foi reservado pelo caller
+static void spawn_thread(thread_pool_t* pool) {
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&tid, &attr, worker_thread, pool);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->starting--;
+        pool->num_threads--;
+        stats_pool_threads(pool->num_threads);
+        if (pool->num_threads == 0) pthread_cond_broadcast(&pool->exited);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+// Corre um refresh agendado (sem cliente: o output só é capturado) e
+// substitui a entrada. O script vê sempre um GET, o pedido que a cache guarda
+static void run_refresh(thread_pool_t* pool, cgi_refresh_t* task) {
+    http_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.method.ptr = "GET";
+    req.method.len = 3;
+    req.version.ptr = task->version;
+    req.version.len = strlen(task->version);
+
+    cgi_capture_t capture;
+    int keep_alive = 0;
+    size_t bytes = 0;
+    if (handle_cgi_request(-1, task->file_path, task->query, &req, &keep_alive, &bytes, &capture) == 200) {
+        cgi_cache_store(pool, task->key, &capture, task->ttl);
+    }
+    cgi_capture_free(&capture);
+}
+
+// Retira um refresh terminado da lista (chamar com o mutex)
+static void refresh_remove(thread_pool_t* pool, cgi_refresh_t* task) {
+    cgi_refresh_t** link = &pool->refreshes;
+    while (*link != task) link = &(*link)->next;
+    *link = task->next;
+    pool->refresh_count--;
+    free(task);
 }
 
 void* worker_thread(void* arg) {
     thread_pool_t* pool = (thread_pool_t*)arg;
+    stats_bind_thread(); // Slot de estatísticas próprio (escrita sem locks)
+    int finished = 0;
+    cgi_refresh_t* refresh = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    pool->starting--;
     while (1) {
-        pthread_mutex_lock(&pool->mutex);
-        while (pool->head == NULL && !pool->shutdown) {
-            pthread_cond_wait(&pool->cond, &pool->mutex);
+        if (refresh) { // Refresh anterior terminou
+            refresh_remove(pool, refresh);
+            refresh = NULL;
         }
-        if (pool->shutdown && pool->head == NULL) {
-            pthread_mutex_unlock(&pool->mutex); break;
+        if (finished) { // Pedido anterior terminou (mesmo lock que o próximo)
+            pool->busy--;
+            publish_load(pool);
+            finished = 0;
         }
-        task_t* task = pool->head;
-        if (task) {
-            pool->head = task->next;
-            if (pool->head == NULL) pool->tail = NULL;
+
+        // 1. Esperar por trabalho; acima do mínimo, uma thread parada
+        // durante THREAD_IDLE_TIMEOUT segundos termina
+        int timed_out = 0;
+        pool->idle++;
+        while (pool->queue_count == 0 && pool->refresh_queued == 0 && !pool->shutdown && !timed_out) {
+            if (pool->num_threads <= pool->min_threads) {
+                pthread_cond_wait(&pool->cond, &pool->mutex);
+                continue;
+            }
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += pool->idle_timeout;
+            timed_out = pthread_cond_timedwait(&pool->cond, &pool->mutex, &deadline) == ETIMEDOUT &&
+                        pool->queue_count == 0 && pool->refresh_queued == 0 &&
+                        pool->num_threads > pool->min_threads;
         }
-        pthread_mutex_unlock(&pool->mutex);
-        if (task) {
-            handle_client(pool, task->client_fd);
-            free(task);
+        pool->idle--;
+
+        // 2. Sem conexões à espera, um refresh da micro-cache (nunca no shutdown)
+        if (pool->queue_count == 0) {
+            if (pool->refresh_queued == 0 || pool->shutdown) break; // Shutdown ou reformada
+            refresh = pool->refreshes;
+            while (refresh->running) refresh = refresh->next;
+            refresh->running = 1;
+            pool->refresh_queued--;
+            pool->busy++;
+            publish_load(pool);
+            pthread_mutex_unlock(&pool->mutex);
+            run_refresh(pool, refresh);
+            finished = 1;
+            pthread_mutex_lock(&pool->mutex);
+            continue;
         }
+
+        // 3. Retirar a conexão mais antiga da fila
+        connection_t* conn = pool->queue[pool->queue_head];
+        pool->queue_head = (pool->queue_head + 1) % pool->queue_size;
+        pool->queue_count--;
+        pool->busy++;
+        publish_load(pool);
+        pthread_mutex_unlock(&pool->mutex);
+        handle_client(pool, conn);
+        finished = 1;
+        pthread_mutex_lock(&pool->mutex);
     }
+    stats_unbind_thread();
+
+    // A última a sair acorda o destroy_thread_pool
+    pool->num_threads--;
+    stats_pool_threads(pool->num_threads);
+    if (pool->num_threads == 0) pthread_cond_broadcast(&pool->exited);
+    pthread_mutex_unlock(&pool->mutex);
     return NULL;
 }
 
-thread_pool_t* create_thread_pool(int num_threads, cache_t* cache, shared_data_t* shm, semaphores_t* sems, server_config_t* config) {
+thread_pool_t* create_thread_pool(int min_threads, int max_threads, cache_t* cache, file_cache_t* files, shared_data_t* shm, semaphores_t* sems, server_config_t* config, event_loop_t* loop) {
     thread_pool_t* pool = malloc(sizeof(thread_pool_t));
     if (!pool) return NULL;
-    
-    // Alocar apenas uma vez (evitar leak)
-    pool->threads = malloc(sizeof(pthread_t) * num_threads);
-    // -----------------------------------------------
+
+    // O event loop também ocupa um slot de estatísticas
+    if (max_threads <= 0) max_threads = 10;
+    if (max_threads > STATS_SLOTS_PER_WORKER - 1) {
+        printf("Thread Pool: THREADS_PER_WORKER limitado a %d\n", STATS_SLOTS_PER_WORKER - 1);
+        max_threads = STATS_SLOTS_PER_WORKER - 1;
+    }
+    if (min_threads <= 0 || min_threads > max_threads) min_threads = max_threads;
 
     pool->config = config;
-    pool->num_threads = num_threads;
-    pool->head = NULL; 
-    pool->tail = NULL;
+    pool->loop = loop;
+    pool->min_threads = min_threads;
+    pool->max_threads = max_threads;
+    pool->idle_timeout = config->thread_idle_timeout > 0 ? config->thread_idle_timeout : 30;
+    pool->num_threads = 0;
+    pool->idle = 0;
+    pool->starting = 0;
+    pool->queue_size = config->max_queue_size > 0 ? config->max_queue_size : MAX_QUEUE_SIZE;
+    pool->queue = malloc(sizeof(connection_t*) * pool->queue_size);
+    pool->queue_head = 0;
+    pool->queue_count = 0;
+    pool->busy = 0;
+    if (!pool->queue) {
+        free(pool);
+        return NULL;
+    }
     pool->shutdown = 0; 
     pool->cache = cache; 
+    pool->files = files;
     pool->shm = shm; 
     pool->sems = sems;
 
     pthread_mutex_init(&pool->mutex, NULL);
     pthread_cond_init(&pool->cond, NULL);
-    for (int i = 0; i < num_threads; i++) 
-        pthread_create(&pool->threads[i], NULL, worker_thread, pool);
+    pthread_cond_init(&pool->exited, NULL);
+    pool->refreshes = NULL;
+    pool->refresh_count = 0;
+    pool->refresh_queued = 0;
+
+    // Arranca com o mínimo; o resto nasce quando a fila o pede
+    pthread_mutex_lock(&pool->mutex);
+    pool->num_threads = min_threads;
+    pool->starting = min_threads;
+    stats_pool_threads(pool->num_threads);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < min_threads; i++) spawn_thread(pool);
     return pool;
 }
 
-void thread_pool_dispatch(thread_pool_t* pool, int client_fd) {
-    task_t* task = malloc(sizeof(task_t));
-    if (!task) { close(client_fd); return; }
-    task->client_fd = client_fd; task->next = NULL;
+// Resposta para quando a fila está cheia: pré-formatada, sai do event loop
+// sem parse, sem alocações e sem ocupar uma thread
+static const char overload_response[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 24\r\n"
+    "Retry-After: 1\r\n"
+    "Server: ConcurrentHTTP/1.0\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "503 Service Unavailable\n";
+
+static void shed_connection(thread_pool_t* pool, connection_t* conn) {
+    // 1. Consumir o pedido já recebido: fechar com dados por ler faz o
+    // kernel enviar RST e o cliente podia perder o 503
+    char drain[4096];
+    for (int i = 0; i < 4 && recv(conn->fd, drain, sizeof(drain), MSG_DONTWAIT) > 0; i++);
+
+    // 2. Responder sem bloquear (se o buffer de envio estiver cheio, só fecha)
+    send(conn->fd, overload_response, sizeof(overload_response) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    stats_request_shed();
+    event_loop_close(pool->loop, conn);
+}
+
+void thread_pool_dispatch(thread_pool_t* pool, connection_t* conn) {
     pthread_mutex_lock(&pool->mutex);
-    if (pool->tail) pool->tail->next = task; else pool->head = task;
-    pool->tail = task;
+    if (pool->queue_count == pool->queue_size) {
+        pthread_mutex_unlock(&pool->mutex);
+        shed_connection(pool, conn);
+        return;
+    }
+    pool->queue[(pool->queue_head + pool->queue_count) % pool->queue_size] = conn;
+    pool->queue_count++;
+    publish_load(pool);
     pthread_cond_signal(&pool->cond);
+
+    // Mais conexões à espera do que threads paradas (ou a arrancar): crescer até ao máximo
+    int grow = pool->queue_count > pool->idle + pool->starting && pool->num_threads < pool->max_threads;
+    if (grow) {
+        pool->num_threads++;
+        pool->starting++;
+        stats_pool_threads(pool->num_threads);
+    }
     pthread_mutex_unlock(&pool->mutex);
+    if (grow) spawn_thread(pool);
 }
 
 void destroy_thread_pool(thread_pool_t* pool) {
@@ -340,24 +826,23 @@ void destroy_thread_pool(thread_pool_t* pool) {
     pthread_cond_broadcast(&pool->cond);
     pthread_mutex_unlock(&pool->mutex);
 
-    // 2. Esperar que elas terminem
-    for (int i = 0; i < pool->num_threads; i++) {
-        pthread_join(pool->threads[i], NULL);
-    }
-
-    // 3. Libertar memória das threads (evitar leak)
-    if (pool->threads) free(pool->threads);
+    // 2. Esperar que elas terminem (são detached: a última sinaliza 'exited')
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->num_threads > 0) pthread_cond_wait(&pool->exited, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
 
-    // 4. Destruir sincronização e a pool
+    // 3. Destruir sincronização e a pool
     pthread_mutex_destroy(&pool->mutex);
     pthread_cond_destroy(&pool->cond);
+    pthread_cond_destroy(&pool->exited);
     
-    // Libertar tarefas pendentes se houver
-    task_t* cur = pool->head;
-    while (cur) {
-        task_t* next = cur->next;
-        free(cur);
-        cur = next;
+    // Conexões que ficaram na fila são fechadas pelo event_loop_destroy;
+    // refreshes que não chegaram a correr são descartados
+    free(pool->queue);
+    while (pool->refreshes) {
+        cgi_refresh_t* next = pool->refreshes->next;
+        free(pool->refreshes);
+        pool->refreshes = next;
     }
 
     free(pool);
@@ -4,41 +4,78 @@
 
 #include <pthread.h>
 #include "cache.h"
+#include "file_cache.h"
 #include "shared_mem.h"
 #include "semaphores.h"
 #include "config.h"
+#include "event_loop.h"
+#include "http.h"
 
-// Estrutura para fila interna
-typedef struct task {
-    int client_fd;
-    struct task* next;
-} task_t;
+// Refreshes de micro-cache CGI pendentes ou em curso por worker
+#define CGI_REFRESH_SLOTS 16
+
+// Refresh de uma entrada da micro-cache CGI servida expirada (STALE): corre
+// numa thread da pool quando não há conexões à espera, fora do pedido que
+// a serviu. Guarda cópias de tudo o que o script precisa.
+typedef struct cgi_refresh {
+    struct cgi_refresh* next;
+    int running; // Já tem uma thread
+    int ttl;
+    char key[HTTP_MAX_PATH + 160];
+    char file_path[1024];
+    char query[HTTP_MAX_PATH + 1];
+    char version[16];
+} cgi_refresh_t;
 
 typedef struct {
-    pthread_t* threads;
-    int num_threads;
+    // Pool elástica: começa com min_threads, cresce até max_threads quando
+    // há mais conexões na fila do que threads paradas e encolhe quando uma
+    // thread fica idle_timeout segundos sem trabalho (threads detached)
+    int min_threads;
+    int max_threads;
+    int idle_timeout;
+    int num_threads; // Vivas (inclui as que estão a arrancar)
+    int idle;        // À espera de trabalho
+    int starting;    // Criadas mas ainda sem passar pelo mutex
     
-    // Fila de tarefas
-    task_t* head;
-    task_t* tail;
+    // Fila de admissão circular com MAX_QUEUE_SIZE posições: cheia, a
+    // conexão recebe logo um 503 em vez de esperar atrás das outras
+    connection_t** queue;
+    int queue_size;
+    int queue_head;
+    int queue_count;
+    int busy; // Conexões a ser processadas pelas threads
     
     pthread_mutex_t mutex;
     pthread_cond_t cond;
+    pthread_cond_t exited; // num_threads chegou a 0 (shutdown)
     int shutdown;
 
     cache_t* cache;
+    file_cache_t* files; // Ficheiros abertos (fd + metadados + header)
 
     server_config_t* config;
+
+    // Event loop do worker (para rearmar/fechar conexões keep-alive)
+    event_loop_t* loop;
     
+    // Micro-cache CGI (com o mutex da pool): refreshes pendentes e em curso.
+    // Uma chave nesta lista está "a refrescar": não se lança outro refresh dela
+    cgi_refresh_t* refreshes;
+    int refresh_count;
+    int refresh_queued; // Ainda à espera de uma thread
+
     // Permite acesso à SHM e aos Semáforos
     shared_data_t* shm; 
     semaphores_t* sems;
 } thread_pool_t;
 
-// Assinatura da função de criação (inclui os novos ponteiros IPC)
-thread_pool_t* create_thread_pool(int num_threads, cache_t* cache, shared_data_t* shm, semaphores_t* sems, server_config_t* config);
+// Assinatura da função de criação (inclui os novos ponteiros IPC).
+// max_threads fica limitado a STATS_SLOTS_PER_WORKER - 1 (slots de stats).
+thread_pool_t* create_thread_pool(int min_threads, int max_threads, cache_t* cache, file_cache_t* files, shared_data_t* shm, semaphores_t* sems, server_config_t* config, event_loop_t* loop);
 
 void destroy_thread_pool(thread_pool_t* pool);
-void thread_pool_dispatch(thread_pool_t* pool, int client_fd);
+// Entrega a conexão às threads; com a fila cheia responde 503 e fecha-a
+void thread_pool_dispatch(thread_pool_t* pool, connection_t* conn);
 
 #endif
\ No newline at end of file
@@ -1,21 +1,32 @@
 // src/worker.c
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // accept4
 #include "worker.h"
 #include "shared_mem.h"
 #include "semaphores.h"
 #include "thread_pool.h"
+#include "event_loop.h"
+#include "stats.h"
+#include "logger.h"
+#include "journal.h"
+#include "cgi.h"
+#include "rebalance.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string.h>
 #include <stdatomic.h>
 
 static atomic_int worker_running = 1;
 
+// data.ptr do socket por onde chegam conexões de outros workers
+static char handoff_tag;
+
 void worker_signal_handler(int signum) {
     (void)signum;
     atomic_store(&worker_running, 0);
@@ -39,42 +50,108 @@ void worker_main(int worker_id, int server_socket, server_config_t* config) {
     semaphores_t sems;
     if (init_semaphores(&sems, 0) < 0) exit(1);
 
-    // Inicializar Cache e Thread Pool
-    cache_t* cache = cache_init(10); // 10MB cache
-    thread_pool_t* pool = create_thread_pool(10, cache, shm, &sems, config);
+    // Estatísticas: a thread principal (event loop) também tem o seu slot
+    stats_init_worker(shm, worker_id);
+    stats_bind_thread();
+
+    // Log assíncrono: as threads só formatam, a escrita é feita em lotes
+    if (logger_init(shm, config->log_file) != 0) fprintf(stderr, "Worker %d: logger indisponível\n", worker_id);
+    journal_attach(worker_id);
+    cgi_pool_worker_init();
+
+    // O socket de escuta é não bloqueante: se outro worker já aceitou a
+    // conexão, o accept() devolve EAGAIN em vez de bloquear o event loop
+    fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL, 0) | O_NONBLOCK);
+
+    // Inicializar Event Loop, Cache e Thread Pool
+    event_loop_t* loop = event_loop_create(server_socket);
+    if (!loop) exit(1);
+    // Cache privada (CACHE_SIZE_MB) ou ligada à cache partilhada do Master
+    cache_t* cache = config->shared_cache ? cache_init_shared(worker_id) : cache_init(config->cache_size_mb);
+    file_cache_t* files = file_cache_create(config->open_file_cache, config->open_file_revalidate);
+    if (!files) exit(1);
+    // Pool elástica entre MIN_THREADS_PER_WORKER e THREADS_PER_WORKER
+    thread_pool_t* pool = create_thread_pool(config->threads_min, config->threads_per_worker,
+                                             cache, files, shm, &sems, config, loop);
+    if (!pool) exit(1);
 
-    // Loop Principal: Worker aceita conexões
+    // Conexões reencaminhadas por workers saturados (REBALANCE=1)
+    int handoff_fd = rebalance_worker_init(shm, worker_id);
+    if (handoff_fd >= 0) {
+        struct epoll_event ev = {.events = EPOLLIN, .data.ptr = &handoff_tag};
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, handoff_fd, &ev);
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    time_t last_sweep = time(NULL);
+
+    // Loop Principal: as threads só recebem conexões com dados prontos
     while (atomic_load(&worker_running)) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-
-        // 1. Bloquear acesso ao accept (Exclusão Mútua entre processos)
-        // Isto evita "Thundering Herd" e garante estabilidade
-        if (sem_wait(sems.queue_mutex) != 0) {
-            if (errno == EINTR) break; 
-            continue;
+        int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Worker epoll_wait");
+            break;
         }
 
-        // 2. Aceitar a conexão
-        int client_fd = accept(server_socket, (struct sockaddr*)&client_addr, &addr_len);
-        
-        // 3. Libertar IMEDIATAMENTE o mutex para outro worker poder aceitar
-        sem_post(sems.queue_mutex);
-
-        // 4. Processar
-        if (client_fd >= 0) {
-            // Enviar para as threads (Onde está o Keep-Alive e Dashboard)
-            thread_pool_dispatch(pool, client_fd);
-        } else {
-            if (errno == EINTR) break;
-            if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                perror("Worker Accept Error");
+        for (int i = 0; i < n; i++) {
+            connection_t* conn = events[i].data.ptr;
+
+            // 0. Conexões entregues por outro worker (já aceites)
+            if (conn == (void*)&handoff_tag) {
+                rebalance_receive(loop);
+                continue;
             }
+
+            // 1. Dados numa conexão existente -> Enviar para as threads
+            if (conn) {
+                event_loop_claim(loop, conn);
+                thread_pool_dispatch(pool, conn);
+                continue;
+            }
+
+            // 2. Nova conexão: bloquear acesso ao accept (Exclusão Mútua entre processos)
+            // Isto evita "Thundering Herd" e garante estabilidade.
+            // Em REUSE_PORT o socket é só deste worker: não há lock.
+            int use_mutex = !config->reuse_port;
+            if (use_mutex && sem_wait(sems.queue_mutex) != 0) continue;
+
+            // Aceitar todas as conexões pendentes de uma vez
+            while (1) {
+                struct sockaddr_in client_addr;
+                socklen_t addr_len = sizeof(client_addr);
+                int client_fd = accept4(server_socket, (struct sockaddr*)&client_addr, &addr_len, SOCK_CLOEXEC);
+                if (client_fd < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        perror("Worker Accept Error");
+                    }
+                    break;
+                }
+                // Pool saturada: entregar a um worker com threads livres
+                if (rebalance_handoff(client_fd, pool->max_threads)) continue;
+                event_loop_add(loop, client_fd);
+            }
+
+            // 3. Libertar o mutex para outro worker poder aceitar
+            if (use_mutex) sem_post(sems.queue_mutex);
+        }
+
+        // 4. Fechar conexões keep-alive inativas
+        time_t now = time(NULL);
+        if (now != last_sweep) {
+            event_loop_sweep(loop);
+            last_sweep = now;
         }
     }
 
-    // Limpeza
+    // Limpeza: deixar de receber conexões; as que já chegaram fecham com o loop
+    rebalance_worker_down(worker_id);
+    rebalance_receive(loop);
     destroy_thread_pool(pool);
+    event_loop_destroy(loop);
     cache_destroy(cache);
+    file_cache_destroy(files);
+    logger_shutdown(); // Depois da pool: já ninguém produz linhas
+    journal_detach();
     exit(0);
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+// tests/bench_accept.c
+// Benchmark de taxa de conexões (uma conexão nova por pedido)
+// Mede quantas conexões/segundo o servidor aceita e serve até ao fim.
+//
+// Compilar: gcc tests/bench_accept.c -o bench_accept -lpthread
+// Usar:     ./bench_accept [threads] [segundos] [path]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#define SERVER_HOST "127.0.0.1"
+#define SERVER_PORT 8080
+
+static atomic_long completed = 0;
+static atomic_long failed = 0;
+static atomic_int running = 1;
+static const char* bench_path = "/index.html";
+
+// Uma conexão completa: connect -> GET -> ler até EOF -> close
+static int one_connection(void) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SERVER_PORT);
+    inet_pton(AF_INET, SERVER_HOST, &addr.sin_addr);
+
+    struct timeval timeout = {5, 0};
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sockfd);
+        return -1;
+    }
+
+    char request[256];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", bench_path);
+    if (send(sockfd, request, len, 0) != len) {
+        close(sockfd);
+        return -1;
+    }
+
+    char buffer[16384];
+    ssize_t n, total = 0;
+    int ok = 0;
+    while ((n = recv(sockfd, buffer, sizeof(buffer), 0)) > 0) {
+        if (total == 0 && n >= 12 && strncmp(buffer, "HTTP/1.1 200", 12) == 0) ok = 1;
+        total += n;
+    }
+    close(sockfd);
+    return ok ? 0 : -1;
+}
+
+static void* client_thread(void* arg) {
+    (void)arg;
+    while (atomic_load(&running)) {
+        if (one_connection() == 0) atomic_fetch_add(&completed, 1);
+        else atomic_fetch_add(&failed, 1);
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    int num_threads = (argc > 1) ? atoi(argv[1]) : 32;
+    int seconds = (argc > 2) ? atoi(argv[2]) : 10;
+    if (argc > 3) bench_path = argv[3];
+    if (num_threads < 1) num_threads = 1;
+    if (seconds < 1) seconds = 1;
+
+    printf("Benchmark de conexões: %d threads, %ds, GET %s\n", num_threads, seconds, bench_path);
+
+    pthread_t* threads = malloc(sizeof(pthread_t) * num_threads);
+    if (!threads) return 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < num_threads; i++) pthread_create(&threads[i], NULL, client_thread, NULL);
+
+    sleep(seconds);
+    atomic_store(&running, 0);
+    for (int i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(threads);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    long ok = atomic_load(&completed);
+    long ko = atomic_load(&failed);
+
+    printf("  Conexões completas: %ld\n", ok);
+    printf("  Falhadas:           %ld\n", ko);
+    printf("  Taxa:               %.0f conexões/s\n", ok / elapsed);
+    return 0;
+}
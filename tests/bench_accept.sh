@@ -0,0 +1,63 @@
+#!/bin/bash
+# tests/bench_accept.sh
+# Compara a taxa de conexões entre os dois modos de accept:
+#   REUSE_PORT=0 -> socket partilhado + semáforo queue_mutex
+#   REUSE_PORT=1 -> um socket SO_REUSEPORT por worker (sem lock)
+# Uso: bash tests/bench_accept.sh [threads] [segundos]
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+THREADS=${1:-32}
+SECONDS_PER_RUN=${2:-10}
+
+if [ ! -f "Makefile" ]; then
+    echo -e "${RED}ERRO: Execute na raiz do projeto!${NC}"
+    exit 1
+fi
+
+make > /dev/null || exit 1
+gcc -O2 tests/bench_accept.c -o bench_accept -lpthread || exit 1
+
+run_mode() {
+    local mode=$1
+    local conf=$(mktemp /tmp/ws_bench_XXXX.conf)
+    grep -v '^REUSE_PORT=' server.conf > "$conf"
+    echo "REUSE_PORT=$mode" >> "$conf"
+
+    pkill -9 -x server 2>/dev/null
+    rm -f /dev/shm/ws_* /dev/shm/sem.ws_* 2>/dev/null || true
+    ./server "$conf" > /dev/null 2>&1 &
+    local pid=$!
+    sleep 2
+
+    if ! kill -0 $pid 2>/dev/null; then
+        echo -e "${RED}ERRO: O servidor falhou ao iniciar (REUSE_PORT=$mode)${NC}"
+        rm -f "$conf"
+        return 1
+    fi
+
+    echo -e "${BLUE}-> REUSE_PORT=$mode${NC}"
+    ./bench_accept "$THREADS" "$SECONDS_PER_RUN" | tee /tmp/ws_bench_$mode.txt
+
+    kill -SIGINT $pid 2>/dev/null
+    wait $pid 2>/dev/null
+    rm -f "$conf"
+    echo ""
+}
+
+run_mode 0
+run_mode 1
+
+RATE0=$(grep -o '[0-9]* conexões/s' /tmp/ws_bench_0.txt | awk '{print $1}')
+RATE1=$(grep -o '[0-9]* conexões/s' /tmp/ws_bench_1.txt | awk '{print $1}')
+echo "---- RESUMO ----"
+echo "Semáforo (queue_mutex): ${RATE0:-?} conexões/s"
+echo "SO_REUSEPORT:           ${RATE1:-?} conexões/s"
+if [ -n "$RATE0" ] && [ -n "$RATE1" ] && [ "$RATE0" -gt 0 ]; then
+    echo -e "${GREEN}Speedup: $(awk -v a="$RATE1" -v b="$RATE0" 'BEGIN { printf "%.2f", a / b }')x${NC}"
+fi
+
+rm -f /tmp/ws_bench_0.txt /tmp/ws_bench_1.txt bench_accept
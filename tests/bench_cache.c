@@ -0,0 +1,108 @@
+// tests/bench_cache.c
+// Microbenchmark do caminho de hit da cache (cache_get + cache_release)
+// Mede hits/segundo com 1, 4, 16 e 64 threads sobre os mesmos objetos.
+//
+// Compilar: gcc -O2 -Isrc tests/bench_cache.c src/cache.c src/shm_cache.c -o bench_cache -lpthread -lrt
+// Usar:     ./bench_cache [num_objetos] [ms_por_ronda]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "cache.h"
+
+#define OBJECT_SIZE 2048
+
+static cache_t* cache;
+static int num_objects = 1000;
+static atomic_int running;
+static char (*keys)[64];
+
+typedef struct {
+    unsigned int seed;
+    long hits;
+} bench_thread_t;
+
+static void* hit_thread(void* arg) {
+    bench_thread_t* t = arg;
+    long hits = 0;
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        // Várias operações por verificação da flag
+        for (int i = 0; i < 256; i++) {
+            const char* key = keys[rand_r(&t->seed) % num_objects];
+            size_t size;
+            const void* data = cache_get(cache, key, &size);
+            if (data) {
+                hits++;
+                cache_release(cache, data);
+            }
+        }
+    }
+    t->hits = hits;
+    return NULL;
+}
+
+static double run_round(int num_threads, int ms) {
+    pthread_t threads[num_threads];
+    bench_thread_t state[num_threads];
+
+    atomic_store(&running, 1);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < num_threads; i++) {
+        state[i].seed = i * 7919 + 1;
+        state[i].hits = 0;
+        pthread_create(&threads[i], NULL, hit_thread, &state[i]);
+    }
+
+    struct timespec wait = {ms / 1000, (ms % 1000) * 1000000L};
+    nanosleep(&wait, NULL);
+    atomic_store(&running, 0);
+
+    long total = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+        total += state[i].hits;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return total / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) num_objects = atoi(argv[1]);
+    int ms = (argc > 2) ? atoi(argv[2]) : 1000;
+    if (num_objects < 1) num_objects = 1;
+
+    // Cache grande o suficiente para todos os objetos (só medimos hits)
+    size_t needed_mb = ((size_t)num_objects * OBJECT_SIZE) / (1024 * 1024) + 1;
+    cache = cache_init(needed_mb * 2);
+    if (!cache) return 1;
+
+    keys = malloc(sizeof(*keys) * num_objects);
+    char body[OBJECT_SIZE];
+    memset(body, 'x', sizeof(body));
+    for (int i = 0; i < num_objects; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "./www/assets/file_%d.css", i);
+        cache_put(cache, keys[i], body, sizeof(body), NULL);
+    }
+
+    printf("Cache hit benchmark: %d objetos de %d bytes, %d shards, %d ms por ronda\n",
+           num_objects, OBJECT_SIZE, CACHE_SHARDS, ms);
+    printf("%8s %16s %16s\n", "threads", "hits/s", "hits/s/thread");
+
+    int thread_counts[] = {1, 4, 16, 64};
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        int n = thread_counts[i];
+        double rate = run_round(n, ms);
+        printf("%8d %16.0f %16.0f\n", n, rate, rate / n);
+    }
+
+    cache_destroy(cache);
+    free(keys);
+    return 0;
+}
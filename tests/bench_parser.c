@@ -0,0 +1,144 @@
+// tests/bench_parser.c
+// Microbenchmark do parser HTTP (parse_http_request)
+// Mede ns/pedido para cada scanner suportado pelo CPU (scalar, sse2, avx2)
+// sobre pedidos reais de browsers, curl e Apache Bench.
+//
+// Compilar: gcc -O2 -Isrc tests/bench_parser.c src/http.c -o bench_parser
+// Usar:     ./bench_parser [iterações]
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "http.h"
+
+static const struct {
+    const char* name;
+    const char* request;
+} corpus[] = {
+    {"ab",
+     "GET /index.html HTTP/1.0\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: ApacheBench/2.3\r\n"
+     "Accept: */*\r\n"
+     "\r\n"},
+    {"ab -k",
+     "GET /style.css HTTP/1.0\r\n"
+     "Connection: Keep-Alive\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: ApacheBench/2.3\r\n"
+     "Accept: */*\r\n"
+     "\r\n"},
+    {"curl",
+     "GET /script.js HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: curl/7.88.1\r\n"
+     "Accept: */*\r\n"
+     "\r\n"},
+    {"chrome",
+     "GET /index.html HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+     "sec-ch-ua-mobile: ?0\r\n"
+     "sec-ch-ua-platform: \"Linux\"\r\n"
+     "Upgrade-Insecure-Requests: 1\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+     "Sec-Fetch-Site: none\r\n"
+     "Sec-Fetch-Mode: navigate\r\n"
+     "Sec-Fetch-User: ?1\r\n"
+     "Sec-Fetch-Dest: document\r\n"
+     "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+     "Accept-Language: pt-PT,pt;q=0.9,en-US;q=0.8,en;q=0.7\r\n"
+     "Cookie: _ga=GA1.1.1234567890.1700000000; session=3f9a1c2b7d8e4f60a1b2c3d4e5f60718\r\n"
+     "\r\n"},
+    {"firefox",
+     "GET /style.css HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+     "Accept: text/css,*/*;q=0.1\r\n"
+     "Accept-Language: pt-PT,pt;q=0.8,en;q=0.5,en-US;q=0.3\r\n"
+     "Accept-Encoding: gzip, deflate, br\r\n"
+     "Connection: keep-alive\r\n"
+     "Referer: http://localhost:8080/\r\n"
+     "Sec-Fetch-Dest: style\r\n"
+     "Sec-Fetch-Mode: no-cors\r\n"
+     "Sec-Fetch-Site: same-origin\r\n"
+     "If-Modified-Since: Tue, 14 May 2024 10:00:00 GMT\r\n"
+     "If-None-Match: \"5f3a-1a2b3c\"\r\n"
+     "\r\n"},
+    {"range",
+     "GET /videos/big.mp4 HTTP/1.1\r\n"
+     "Host: localhost:8080\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+     "Accept: */*\r\n"
+     "Range: bytes=1048576-2097151\r\n"
+     "Connection: keep-alive\r\n"
+     "\r\n"},
+};
+
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ns por pedido para um pedido do corpus
+static double bench_one(const char* request, long iterations) {
+    size_t len = strlen(request);
+    http_request_t req;
+    volatile long sink = 0; // Impede o compilador de eliminar o parse
+
+    double start = now_ns();
+    for (long i = 0; i < iterations; i++) {
+        size_t scanned = 0;
+        sink += parse_http_request(request, len, &scanned, &req);
+    }
+    double elapsed = now_ns() - start;
+
+    if (sink != (long)len * iterations) {
+        fprintf(stderr, "Parse falhou: %.20s...\n", request);
+        exit(1);
+    }
+    return elapsed / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 1000000;
+    const char* scanners[] = {"scalar", "sse2", "avx2"};
+    const char* detected = http_scanner_name();
+
+    printf("Parser benchmark: %ld iterações por pedido (scanner por omissão: %s)\n", iterations, detected);
+    printf("%-10s %6s", "pedido", "bytes");
+    for (size_t s = 0; s < 3; s++) printf(" %10s", scanners[s]);
+    printf("   (ns/pedido)\n");
+
+    double totals[3] = {0};
+    for (size_t c = 0; c < CORPUS_SIZE; c++) {
+        printf("%-10s %6zu", corpus[c].name, strlen(corpus[c].request));
+        for (size_t s = 0; s < 3; s++) {
+            if (http_scanner_select(scanners[s]) != 0) {
+                printf(" %10s", "-");
+                continue;
+            }
+            double ns = bench_one(corpus[c].request, iterations);
+            totals[s] += ns;
+            printf(" %10.1f", ns);
+        }
+        printf("\n");
+    }
+
+    printf("%-10s %6s", "média", "");
+    for (size_t s = 0; s < 3; s++) {
+        if (totals[s] > 0) printf(" %10.1f", totals[s] / CORPUS_SIZE);
+        else printf(" %10s", "-");
+    }
+    printf("\n");
+
+    http_scanner_select(detected);
+    return 0;
+}
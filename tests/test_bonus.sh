@@ -48,7 +48,7 @@ else
 fi
 
 # ---------------------------------------------------------
-# TESTE 3: Keep-Alive
+# TESTE 4: Keep-Alive
 # ---------------------------------------------------------
 echo -n "4. Testing Keep-Alive Header... "
 # Verifica se o header Connection: keep-alive está presente na resposta
@@ -60,7 +60,7 @@ else
 fi
 
 # ---------------------------------------------------------
-# TESTE 4: Range Requests (HTTP 206)
+# TESTE 5: Range Requests (HTTP 206)
 # ---------------------------------------------------------
 echo -n "5. Testing Range Requests (bytes=0-10)... "
 
@@ -87,7 +87,7 @@ fi
 rm -f /tmp/headers_range.txt /tmp/body_range.txt
 
 # ---------------------------------------------------------
-# TESTE 5: CGI Script (Python)
+# TESTE 6: CGI Script (Python)
 # ---------------------------------------------------------
 echo -n "6. Testing CGI Script Execution (test_cgi.py)... "
 
@@ -112,6 +112,228 @@ fi
 # Limpeza do ficheiro temporário
 rm -f www/test_cgi.py
 
+# Pedido HTTP cru numa só conexão (printf). Com 3 argumentos, envia o
+# primeiro, espera $2 segundos e envia o terceiro (pedido partido em dois).
+raw_request() {
+    exec 3<>/dev/tcp/localhost/8080
+    printf "$1" >&3
+    if [ $# -ge 3 ]; then
+        sleep "$2"
+        printf "$3" >&3
+    fi
+    timeout 2 cat <&3
+    exec 3<&-
+}
+
+# ---------------------------------------------------------
+# TESTE 7: Pipelining e pedidos partidos
+# ---------------------------------------------------------
+echo -n "7. Testing Pipelining (2 pedidos num só envio)... "
+COUNT=$(raw_request "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\nGET /style.css HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n" | grep -c "HTTP/1.1 200")
+if [ "$COUNT" -eq 2 ]; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Respostas 200: $COUNT de 2)"
+fi
+
+echo -n "8. Testing Pedido partido entre leituras... "
+STATUS=$(raw_request "GET /index.html HTTP/1.1\r\nHo" 0.3 "st: localhost\r\nConnection: close\r\n\r\n" | head -n 1)
+if [[ "$STATUS" == *"200"* ]]; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Recebido: $STATUS)"
+fi
+
+echo -n "9. Testing Transfer-Encoding (501) e corpo grande (413)... "
+TE=$(raw_request "POST /index.html HTTP/1.1\r\nHost: localhost\r\nTransfer-Encoding: chunked\r\n\r\n" | head -n 1)
+BIG=$(raw_request "POST /index.html HTTP/1.1\r\nHost: localhost\r\nContent-Length: 99999999999999999999\r\n\r\n" | head -n 1)
+if [[ "$TE" == *"501"* ]] && [[ "$BIG" == *"413"* ]]; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Recebido: $TE / $BIG)"
+fi
+
+echo -n "10. Testing CR solto nos headers (400, servidor continua)... "
+# Um CR sem LF antes do fim dos headers não pode derrubar o worker: vários
+# envios para chegar a todos os workers, que o master não volta a criar
+BAD=0
+for i in 1 2 3 4 5 6 7 8; do
+    R=$(raw_request "GET / HTTP/1.1\r\nA: b\r\r\n\r\n" | head -n 1)
+    [[ -z "$R" || "$R" == *"400"* ]] || BAD=$((BAD + 1))
+    R=$(raw_request "GET / HTTP/1.1\r\r\n\r\n" | head -n 1)
+    [[ -z "$R" || "$R" == *"400"* ]] || BAD=$((BAD + 1))
+done
+ALIVE=0
+for i in 1 2 3 4 5 6 7 8; do
+    [ "$(curl -s -o /dev/null -w "%{http_code}" "$SERVER_URL/index.html")" == "200" ] && ALIVE=$((ALIVE + 1))
+done
+if [ "$BAD" -eq 0 ] && [ "$ALIVE" -eq 8 ]; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Respostas inesperadas: $BAD, 200 depois: $ALIVE de 8)"
+fi
+
+# ---------------------------------------------------------
+# TESTE 11: Pedidos condicionais (304)
+# ---------------------------------------------------------
+echo -n "11. Testing If-None-Match / If-Modified-Since (304)... "
+HEADERS=$(curl -s -I "$SERVER_URL/index.html")
+ETAG=$(echo "$HEADERS" | grep -i "^ETag:" | cut -d' ' -f2- | tr -d '\r')
+LAST_MOD=$(echo "$HEADERS" | grep -i "^Last-Modified:" | cut -d' ' -f2- | tr -d '\r')
+INM=$(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: $ETAG" "$SERVER_URL/index.html")
+IMS=$(curl -s -o /dev/null -w "%{http_code}" -H "If-Modified-Since: $LAST_MOD" "$SERVER_URL/index.html")
+# ETag diferente: If-None-Match tem prioridade e o ficheiro é enviado
+OTHER=$(curl -s -o /dev/null -w "%{http_code}" -H "If-None-Match: \"outro\"" -H "If-Modified-Since: $LAST_MOD" "$SERVER_URL/index.html")
+if [ "$INM" = "304" ] && [ "$IMS" = "304" ] && [ "$OTHER" = "200" ]; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (INM: $INM, IMS: $IMS, ETag diferente: $OTHER)"
+fi
+
+# ---------------------------------------------------------
+# TESTE 12: Compressão gzip
+# ---------------------------------------------------------
+echo -n "12. Testing gzip (Vary, q=0 recusa)... "
+GZ=$(curl -s -D - -o /tmp/body_gzip.gz -H "Accept-Encoding: gzip" "$SERVER_URL/index.html")
+REFUSED=$(curl -s -D - -o /dev/null -H "Accept-Encoding: gzip;q=0, identity" "$SERVER_URL/index.html")
+if echo "$GZ" | grep -qi "^Content-Encoding: gzip" && echo "$GZ" | grep -qi "^Vary: Accept-Encoding" &&
+   gzip -dc /tmp/body_gzip.gz | cmp -s - www/index.html &&
+   ! echo "$REFUSED" | grep -qi "^Content-Encoding" && echo "$REFUSED" | grep -qi "^Vary: Accept-Encoding"; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Headers gzip ou q=0 incorretos)"
+fi
+rm -f /tmp/body_gzip.gz
+
+# ---------------------------------------------------------
+# TESTE 13: Vários intervalos (multipart) e 416
+# ---------------------------------------------------------
+echo -n "13. Testing Range multipart/byteranges e 416... "
+SIZE=$(wc -c < www/index.html)
+MULTI=$(curl -s -D - -H "Range: bytes=0-9,20-29" "$SERVER_URL/index.html")
+PARTS=$(echo "$MULTI" | grep -c "^Content-Range: bytes")
+UNSAT=$(curl -s -D - -o /dev/null -H "Range: bytes=$((SIZE + 100))-" "$SERVER_URL/index.html")
+if echo "$MULTI" | grep -q "HTTP/1.1 206" && echo "$MULTI" | grep -q "multipart/byteranges; boundary=" &&
+   [ "$PARTS" -eq 2 ] && echo "$UNSAT" | grep -q "HTTP/1.1 416" &&
+   echo "$UNSAT" | grep -q "Content-Range: bytes \*/$SIZE"; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Partes: $PARTS, 416: $(echo "$UNSAT" | head -n 1))"
+fi
+
+# ---------------------------------------------------------
+# TESTE 14: Headers CGI e output em streaming
+# ---------------------------------------------------------
+echo -n "14. Testing CGI Status/headers e chunked... "
+cat > www/test_cgi_headers.py << 'EOF'
+print("Status: 201 Created")
+print("Content-Type: text/plain")
+print("X-Cgi-Test: sim")
+print()
+print("parte 1")
+EOF
+cat > www/test_cgi_stream.py << 'EOF'
+import time
+print("primeiro bloco", flush=True)
+time.sleep(0.3)  # O servidor já respondeu sem saber o tamanho total
+print("segundo bloco")
+EOF
+HEADERS=$(curl -s -D - "$SERVER_URL/test_cgi_headers.py")
+STREAM=$(curl -s -D - "$SERVER_URL/test_cgi_stream.py")
+if echo "$HEADERS" | grep -q "HTTP/1.1 201 Created" && echo "$HEADERS" | grep -qi "^Content-Type: text/plain" &&
+   echo "$HEADERS" | grep -qi "^X-Cgi-Test: sim" && echo "$HEADERS" | grep -q "parte 1" &&
+   echo "$STREAM" | grep -qi "^Transfer-Encoding: chunked" && echo "$STREAM" | grep -q "segundo bloco"; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (Status/headers CGI ou chunked incorretos)"
+fi
+rm -f www/test_cgi_headers.py www/test_cgi_stream.py
+
+# Servidor próprio na porta 8081 com uma configuração de teste ($1), para
+# funcionalidades que o server.conf não liga. Só um worker: o estado (cache,
+# fila) é o mesmo para todos os pedidos do teste.
+PRIVATE_URL="http://localhost:8081"
+start_private_server() {
+    cat > /tmp/ws_bonus.conf << EOF
+PORT=8081
+DOCUMENT_ROOT=./www
+NUM_WORKERS=1
+THREADS_PER_WORKER=4
+CACHE_SIZE_MB=4
+LOG_FILE=/tmp/ws_bonus_access.log
+TIMEOUT_SECONDS=30
+JOURNAL_ENTRIES=0
+CGI_POOL_SIZE=2
+CGI_TIMEOUT=10
+REBALANCE=0
+$1
+EOF
+    ./server /tmp/ws_bonus.conf > /tmp/ws_bonus_server.log 2>&1 &
+    PRIVATE_PID=$!
+    sleep 1.5
+}
+stop_private_server() {
+    kill -INT $PRIVATE_PID 2>/dev/null
+    wait $PRIVATE_PID 2>/dev/null
+    rm -f /tmp/ws_bonus.conf /tmp/ws_bonus_access.log /tmp/ws_bonus_server.log
+}
+
+# ---------------------------------------------------------
+# TESTE 15: Micro-cache CGI e métodos
+# ---------------------------------------------------------
+echo -n "15. Testing Micro-cache CGI (HIT, POST sem cache)... "
+cat > www/test_cgi_cache.py << 'EOF'
+import os, time
+print(os.environ["REQUEST_METHOD"], time.time_ns())
+EOF
+start_private_server "CGI_CACHE_/test_cgi_cache.py=30"
+# POST nunca é guardado: o GET seguinte corre o script
+POST_FIRST=$(curl -s -X POST "$PRIVATE_URL/test_cgi_cache.py?p=1")
+AFTER_POST=$(curl -s -D - "$PRIVATE_URL/test_cgi_cache.py?p=1")
+# GET guardado: o segundo é HIT com o mesmo corpo; um POST passa ao lado da cache
+GET1=$(curl -s "$PRIVATE_URL/test_cgi_cache.py")
+GET2=$(curl -s -D - "$PRIVATE_URL/test_cgi_cache.py")
+POST=$(curl -s -D - -X POST "$PRIVATE_URL/test_cgi_cache.py")
+if [[ "$POST_FIRST" == POST* ]] && ! echo "$AFTER_POST" | grep -q "X-Cache" &&
+   echo "$AFTER_POST" | grep -q "^GET " && echo "$GET2" | grep -q "X-Cache: HIT" &&
+   echo "$GET2" | grep -q "^$GET1" && ! echo "$POST" | grep -q "X-Cache" && echo "$POST" | grep -q "^POST "; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (HIT ou separação GET/POST incorretos)"
+fi
+stop_private_server
+rm -f www/test_cgi_cache.py
+
+# ---------------------------------------------------------
+# TESTE 16: Fila cheia responde 503
+# ---------------------------------------------------------
+echo -n "16. Testing Fila cheia (503 + Retry-After)... "
+cat > www/test_cgi_slow.py << 'EOF'
+import time
+time.sleep(2)
+print("lento")
+EOF
+# Uma thread e uma posição na fila: do terceiro pedido em diante é 503
+start_private_server "THREADS_PER_WORKER=1
+MIN_THREADS_PER_WORKER=1
+MAX_QUEUE_SIZE=1"
+CURL_PIDS=""
+for i in 1 2 3 4 5 6; do
+    curl -s -D "/tmp/ws_shed_$i.txt" -o /dev/null "$PRIVATE_URL/test_cgi_slow.py" &
+    CURL_PIDS="$CURL_PIDS $!"
+done
+wait $CURL_PIDS # Só os curl (o servidor privado também é um job)
+SHED=$(grep -l "HTTP/1.1 503" /tmp/ws_shed_*.txt | wc -l)
+SERVED=$(grep -l "HTTP/1.1 200" /tmp/ws_shed_*.txt | wc -l)
+RETRY=$(grep -l "Retry-After: 1" /tmp/ws_shed_*.txt | wc -l)
+if [ "$SHED" -gt 0 ] && [ "$SERVED" -gt 0 ] && [ "$RETRY" -eq "$SHED" ]; then
+    echo -e "${GREEN}[ PASS ]${NC}"
+else
+    echo -e "${RED}[ FAIL ]${NC} (503: $SHED, 200: $SERVED, Retry-After: $RETRY)"
+fi
+stop_private_server
+rm -f www/test_cgi_slow.py /tmp/ws_shed_*.txt
+
 echo ""
 echo "Teste concluído."
 rm -f /tmp/stats_output.html
\ No newline at end of file
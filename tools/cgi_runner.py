@@ -0,0 +1,173 @@
+# tools/cgi_runner.py
+# Interpretador persistente do pool CGI (CGI_POOL_SIZE no server.conf).
+# O Master lança N cópias; todas fazem accept() no mesmo socket Unix.
+# Cada conexão é um pedido:
+#   worker -> runner: linhas "NOME=valor" (ambiente CGI) + linha vazia
+#   runner -> worker: frames [tipo:1][tamanho:4, big-endian][dados]
+#     'D' + output do script (enviado à medida que o script escreve)
+#     'E' + status no campo tamanho (0 = sucesso), sem dados; fim do pedido
+# O script corre neste processo (runpy), sem fork nem arranque do python3.
+# Entre pedidos o processo volta ao estado do arranque: sys.modules,
+# sys.argv, sys.path, os.environ e o diretório atual são repostos, por isso
+# um script não vê módulos nem variáveis deixados pelo pedido anterior.
+#
+# Segurança: o socket está num diretório 0700 do Master; além disso só são
+# aceites ligações do mesmo uid (SO_PEERCRED) e scripts dentro das raízes.
+#
+# Usar: python3 tools/cgi_runner.py <fd do socket> <timeout em segundos> <raiz>...
+
+import io
+import os
+import runpy
+import signal
+import socket
+import struct
+import sys
+import traceback
+
+FRAME_BUFFER = 16384  # Prints pequenos juntam-se num só frame
+
+
+class ScriptTimeout(Exception):
+    pass
+
+
+def on_alarm(signum, frame):
+    raise ScriptTimeout()
+
+
+class FrameWriter(io.RawIOBase):
+    # Cada escrita do buffer vira um frame 'D' no socket. No fim do script
+    # o último frame espera pelo 'E' e seguem juntos: o worker vê logo que
+    # o output acabou e responde com Content-Length.
+    def __init__(self, conn):
+        self.conn = conn
+        self.hold = False
+        self.pending = b""
+
+    def writable(self):
+        return True
+
+    def write(self, data):
+        if data:
+            frame = b"D" + struct.pack(">I", len(data)) + bytes(data)
+            if self.hold:
+                self.pending += frame
+            else:
+                self.conn.sendall(frame)
+        return len(data)
+
+    def finish(self, status):
+        self.conn.sendall(self.pending + b"E" + struct.pack(">I", status))
+
+
+def read_env(conn):
+    # 1. Ambiente CGI até à linha vazia
+    reader = conn.makefile("rb")
+    env = {}
+    for line in reader:
+        line = line.rstrip(b"\n")
+        if not line:
+            break
+        name, _, value = line.partition(b"=")
+        env[name.decode()] = value.decode("utf-8", "replace")
+    reader.close()
+    return env
+
+
+def peer_allowed(conn):
+    # Só o utilizador do servidor (os workers) pode pedir scripts
+    creds = conn.getsockopt(socket.SOL_SOCKET, socket.SO_PEERCRED, struct.calcsize("3i"))
+    _, uid, _ = struct.unpack("3i", creds)
+    return uid == os.getuid()
+
+
+def script_allowed(path, roots):
+    # Caminho real (sem "..", sem symlinks) tem de estar dentro de uma raiz
+    real = os.path.realpath(path)
+    return any(real.startswith(root + os.sep) for root in roots)
+
+
+def run_script(conn, env, timeout, baseline):
+    # 2. Correr o script com stdout ligado ao socket e o ambiente do pedido
+    frames = FrameWriter(conn)
+    raw = io.BufferedWriter(frames, buffer_size=FRAME_BUFFER)
+    stdout = io.TextIOWrapper(raw, encoding="utf-8")
+    script = env["SCRIPT_FILENAME"]
+    saved_stdout = sys.stdout
+    sys.stdout = stdout
+    os.environ.update(env)
+    sys.argv = [script]
+    sys.path.insert(0, os.path.dirname(os.path.abspath(script)))  # Como "python3 script.py"
+    status = 0
+    signal.alarm(timeout)
+    try:
+        runpy.run_path(script, run_name="__main__")
+    except SystemExit as e:
+        status = 0 if e.code in (None, 0) else 1
+    except ScriptTimeout:
+        print("CGI timeout: %s" % env.get("SCRIPT_FILENAME"), file=sys.stderr)
+        status = 1
+    except (BrokenPipeError, ConnectionResetError):
+        raise  # O worker desistiu: não há a quem responder
+    except BaseException:
+        traceback.print_exc()
+        status = 1
+    finally:
+        signal.alarm(0)
+        sys.stdout = saved_stdout
+        reset_state(baseline)
+    frames.hold = True
+    stdout.flush()
+    frames.finish(status)
+
+
+def snapshot_state():
+    return {
+        "modules": set(sys.modules),
+        "argv": list(sys.argv),
+        "path": list(sys.path),
+        "environ": dict(os.environ),
+        "cwd": os.getcwd(),
+    }
+
+
+def reset_state(baseline):
+    # 3. Esquecer tudo o que o script deixou: módulos que importou (e que
+    # guardariam estado para o pedido seguinte), argv, path, ambiente e cwd
+    for name in set(sys.modules) - baseline["modules"]:
+        del sys.modules[name]
+    sys.argv = list(baseline["argv"])
+    sys.path[:] = baseline["path"]
+    os.environ.clear()
+    os.environ.update(baseline["environ"])
+    os.chdir(baseline["cwd"])
+
+
+def main():
+    listener = socket.socket(fileno=int(sys.argv[1]))
+    timeout = int(sys.argv[2]) if len(sys.argv) > 2 else 30
+    roots = [os.path.realpath(root) for root in sys.argv[3:]]
+    signal.signal(signal.SIGINT, signal.SIG_IGN)  # O Master decide quando terminar (SIGTERM)
+    signal.signal(signal.SIGALRM, on_alarm)
+    baseline = snapshot_state()
+
+    while True:
+        conn, _ = listener.accept()
+        with conn:
+            try:
+                if not peer_allowed(conn):
+                    continue
+                env = read_env(conn)
+                if "SCRIPT_FILENAME" not in env:
+                    continue
+                if not script_allowed(env["SCRIPT_FILENAME"], roots):
+                    print("CGI recusado (fora das raízes): %s" % env["SCRIPT_FILENAME"], file=sys.stderr)
+                    continue
+                run_script(conn, env, timeout, baseline)
+            except (BrokenPipeError, ConnectionResetError):
+                pass  # O worker desistiu (cliente fechou ou timeout do lado dele)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+// tools/journal_tool.c
+// Leitura offline do journal binário de pedidos (JOURNAL_ENTRIES no server.conf).
+// Pode ler o journal do servidor em execução ou uma cópia guardada.
+//
+// Compilar: make journal_tool
+// Usar:     ./journal_tool [-f ficheiro] [-s status] [-w worker] [-c classe] [-p path] [-n N] [-a]
+//   -f  ficheiro do journal (por omissão /dev/shm/webserver_journal)
+//   -s  só registos com este status HTTP
+//   -w  só registos deste worker
+//   -c  só esta classe: hit, miss, cgi, error
+//   -p  só pedidos a este path (compara o hash FNV-1a)
+//   -n  só os últimos N registos
+//   -a  em vez de listar, mostra totais por status e percentis por classe
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "journal.h"
+#include "shared_mem.h"
+
+static const char* class_names[LAT_CLASSES] = {"hit", "miss", "cgi", "error"};
+
+typedef struct {
+    int status;
+    int worker;
+    int lat_class;
+    int has_path;
+    uint64_t path_hash;
+} filter_t;
+
+static int matches(const journal_record_t* r, const filter_t* f) {
+    if (f->status >= 0 && r->status != f->status) return 0;
+    if (f->worker >= 0 && r->worker != f->worker) return 0;
+    if (f->lat_class >= 0 && r->lat_class != f->lat_class) return 0;
+    if (f->has_path && r->path_hash != f->path_hash) return 0;
+    return 1;
+}
+
+static void print_record(const journal_record_t* r) {
+    time_t sec = r->timestamp_us / 1000000;
+    struct tm tm_info;
+    localtime_r(&sec, &tm_info);
+    char ts[32];
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    const char* cls = (r->lat_class < LAT_CLASSES) ? class_names[r->lat_class] : "?";
+    printf("%s.%06lu w%-2u %3u %10lu %9uus %-5s %016lx\n",
+           ts, (unsigned long)(r->timestamp_us % 1000000), r->worker, r->status,
+           (unsigned long)r->bytes, r->latency_us, cls, (unsigned long)r->path_hash);
+}
+
+static int cmp_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t* sorted, size_t n, double q) {
+    size_t idx = (size_t)(q * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void print_summary(journal_record_t** sel, size_t n) {
+    if (n == 0) {
+        printf("Sem registos.\n");
+        return;
+    }
+
+    // 1. Totais e distribuição de status
+    uint64_t bytes = 0, first = sel[0]->timestamp_us, last = sel[0]->timestamp_us;
+    long by_status[600] = {0};
+    for (size_t i = 0; i < n; i++) {
+        bytes += sel[i]->bytes;
+        if (sel[i]->timestamp_us < first) first = sel[i]->timestamp_us;
+        if (sel[i]->timestamp_us > last) last = sel[i]->timestamp_us;
+        if (sel[i]->status < 600) by_status[sel[i]->status]++;
+    }
+    double span = (last - first) / 1e6;
+    printf("Registos: %zu | Bytes: %lu | Intervalo: %.3fs", n, (unsigned long)bytes, span);
+    if (span > 0) printf(" | %.0f req/s", n / span);
+    printf("\n\nStatus:\n");
+    for (int s = 0; s < 600; s++) {
+        if (by_status[s]) printf("  %3d %10ld\n", s, by_status[s]);
+    }
+
+    // 2. Percentis exatos de latência por classe
+    uint32_t* lat = malloc(sizeof(uint32_t) * n);
+    if (!lat) return;
+    printf("\nLatência (us)  count      p50      p90      p99    p99.9      max\n");
+    for (int c = 0; c < LAT_CLASSES; c++) {
+        size_t m = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (sel[i]->lat_class == c) lat[m++] = sel[i]->latency_us;
+        }
+        if (m == 0) continue;
+        qsort(lat, m, sizeof(uint32_t), cmp_u32);
+        printf("  %-6s %10zu %8u %8u %8u %8u %8u\n", class_names[c], m,
+               percentile(lat, m, 0.50), percentile(lat, m, 0.90),
+               percentile(lat, m, 0.99), percentile(lat, m, 0.999), lat[m - 1]);
+    }
+    free(lat);
+}
+
+int main(int argc, char* argv[]) {
+    const char* file = JOURNAL_PATH;
+    filter_t f = {-1, -1, -1, 0, 0};
+    long last_n = -1;
+    int aggregate = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:s:w:c:p:n:a")) != -1) {
+        switch (opt) {
+            case 'f': file = optarg; break;
+            case 's': f.status = atoi(optarg); break;
+            case 'w': f.worker = atoi(optarg); break;
+            case 'p': f.has_path = 1; f.path_hash = journal_hash_path(optarg); break;
+            case 'n': last_n = atol(optarg); break;
+            case 'a': aggregate = 1; break;
+            case 'c':
+                for (int c = 0; c < LAT_CLASSES; c++) {
+                    if (strcmp(optarg, class_names[c]) == 0) f.lat_class = c;
+                }
+                if (f.lat_class < 0) {
+                    fprintf(stderr, "Classe desconhecida: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Uso: %s [-f ficheiro] [-s status] [-w worker] [-c hit|miss|cgi|error] [-p path] [-n N] [-a]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // 1. Ler o ficheiro inteiro (cópia estável mesmo com o servidor a escrever)
+    FILE* fp = fopen(file, "rb");
+    if (!fp) {
+        perror(file);
+        return 1;
+    }
+    journal_header_t h;
+    if (fread(&h, sizeof(h), 1, fp) != 1 || h.magic != JOURNAL_MAGIC ||
+        h.record_size != sizeof(journal_record_t) || h.capacity == 0) {
+        fprintf(stderr, "%s: não é um journal válido (versão %d)\n", file, JOURNAL_VERSION);
+        fclose(fp);
+        return 1;
+    }
+    journal_record_t* records = malloc(h.capacity * sizeof(journal_record_t));
+    if (!records || fread(records, sizeof(journal_record_t), h.capacity, fp) != h.capacity) {
+        fprintf(stderr, "%s: journal truncado\n", file);
+        fclose(fp);
+        free(records);
+        return 1;
+    }
+    fclose(fp);
+
+    // 2. Percorrer por ordem de posição; registos sobrescritos ou a meio
+    // da escrita têm um seq diferente do esperado e são ignorados
+    uint64_t end = h.head;
+    uint64_t start = (end > h.capacity) ? end - h.capacity : 0;
+    journal_record_t** sel = malloc(sizeof(journal_record_t*) * h.capacity);
+    size_t n = 0;
+    for (uint64_t pos = start; pos < end && sel; pos++) {
+        journal_record_t* r = &records[pos & (h.capacity - 1)];
+        if (r->seq == pos + 1 && matches(r, &f)) sel[n++] = r;
+    }
+
+    if (last_n >= 0 && (size_t)last_n < n) {
+        memmove(sel, sel + (n - last_n), sizeof(journal_record_t*) * last_n);
+        n = last_n;
+    }
+
+    // 3. Listar ou agregar
+    if (aggregate) {
+        print_summary(sel, n);
+    } else {
+        for (size_t i = 0; i < n; i++) print_record(sel[i]);
+    }
+
+    free(sel);
+    free(records);
+    return 0;
+}